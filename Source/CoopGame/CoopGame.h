@@ -3,9 +3,14 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "Stats/Stats.h"
 
 //Giving Alternative names to variables
 #define SURFACE_FLESHDEFAULT		SurfaceType1
 #define SURFACE_FLESHVULNERABLE		SurfaceType2
 
-#define COLLISION_WEAPON			ECC_GameTraceChannel1
\ No newline at end of file
+#define COLLISION_WEAPON			ECC_GameTraceChannel1
+#define COLLISION_TRACKERBOT		ECC_GameTraceChannel2
+
+//Stat group for gameplay systems. View with "stat CoopGame"
+DECLARE_STATS_GROUP(TEXT("CoopGame"), STATGROUP_CoopGame, STATCAT_Advanced);
@@ -3,14 +3,21 @@
 
 #include "AI/STrackerBot.h"
 #include "Kismet/GameplayStatics.h"
-#include "NavigationSystem.h"
-#include "NavigationPath.h"
+#include "GameFramework/DamageType.h"
+#include "NavigationData.h"
 #include "GameFramework/Character.h"
 #include "DrawDebugHelpers.h"
 #include "SCharacter.h"
 #include "Components/SHealthComponent.h"
-#include "Components/SphereComponent.h"
 #include "Sound/SoundCue.h"
+#include "Subsystems/STargetIndexSubsystem.h"
+#include "Subsystems/SPathRequestSubsystem.h"
+#include "Subsystems/SFlowFieldSubsystem.h"
+#include "Subsystems/STrackerBotSubsystem.h"
+#include "Subsystems/SExplosionSubsystem.h"
+#include "SGameMode.h"
+#include "Net/UnrealNetwork.h"
+#include "../../CoopGame.h"
 
 
 //Created a console variable. Global
@@ -22,24 +29,33 @@ FAutoConsoleVariableRef CVARTrackerBotDrawing(
 	ECVF_Cheat);
 
 
+DECLARE_DWORD_COUNTER_STAT(TEXT("TrackerBot Path Queries"), STAT_TrackerBotPathQueries, STATGROUP_CoopGame);
+DECLARE_DWORD_COUNTER_STAT(TEXT("TrackerBot Path Queries Avoided"), STAT_TrackerBotPathQueriesAvoided, STATGROUP_CoopGame);
+
+//How often the current path is checked against the target
+static const float PathCheckInterval = 1.0f;
+
+//How long the explosion plays before the bot is cleaned up
+static const float ExplodedLifeSpan = 2.0f;
+
+//Custom primitive data slot the bot material reads LastTimeDamageTaken from
+static const int32 DamagePulseDataIndex = 0;
+
+
 // Sets default values
 ASTrackerBot::ASTrackerBot()
 {
- 	// Set this pawn to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
-	PrimaryActorTick.bCanEverTick = true;
+ 	//Steered by the tracker bot subsystem, no tick of our own
+	PrimaryActorTick.bCanEverTick = false;
 
 	MeshComp = CreateDefaultSubobject<UStaticMeshComponent>(TEXT("MeshComp"));
 	MeshComp->SetCanEverAffectNavigation(false);
 	MeshComp->SetSimulatePhysics(true);
+	//Bots keep apart through crowd separation, no contacts between them
+	MeshComp->SetCollisionObjectType(COLLISION_TRACKERBOT);
+	MeshComp->SetCollisionResponseToChannel(COLLISION_TRACKERBOT, ECR_Ignore);
 	RootComponent = MeshComp;
 
-	SphereComp = CreateDefaultSubobject<USphereComponent>(TEXT("SphereComp"));
-	SphereComp->SetSphereRadius(200);
-	SphereComp->SetCollisionEnabled(ECollisionEnabled::QueryOnly);
-	SphereComp->SetCollisionResponseToAllChannels(ECR_Ignore);
-	SphereComp->SetCollisionResponseToChannel(ECC_Pawn, ECR_Overlap);
-	SphereComp->SetupAttachment(RootComponent);
-
 	HealthComp = CreateDefaultSubobject<USHealthComponent>(TEXT("HealthComp"));
 	HealthComp->OnHealthChanged.AddDynamic(this, &ASTrackerBot::HandleTakeDamage);
 
@@ -51,6 +67,12 @@ ASTrackerBot::ASTrackerBot()
 	ExplosionRadius = 350;
 
 	SelfDamageInterval = 0.25f;
+	SelfDestructTriggerRadius = 200.0f;
+
+	RepathDistance = 300.0f;
+	BlockedPathTime = 2.0f;
+
+	PathIndex = 0;
 }
 
 // Called when the game starts or when spawned
@@ -60,101 +82,277 @@ void ASTrackerBot::BeginPlay()
 
 	if (HasAuthority())
 	{
-		//Find initial move to
-		NextPathPoint = GetNextPathPoint();
+		StartHunting();
 	}
 }
 
+void ASTrackerBot::StartHunting()
+{
+	//Find initial move to
+	NextPathPoint = GetActorLocation();
+	RepathIfNeeded();
+
+	USGameplayTimerSubsystem* Timers = GetWorld()->GetSubsystem<USGameplayTimerSubsystem>();
+	if (Timers)
+	{
+		Timers->SetTimer<ASTrackerBot, &ASTrackerBot::RefreshPath>(TimerHandle_RefreshPath, this, PathCheckInterval, true, ESGameplayTimerCategory::BotPath);
+	}
+
+	USTrackerBotSubsystem* TrackerBots = GetWorld()->GetSubsystem<USTrackerBotSubsystem>();
+	if (TrackerBots)
+	{
+		TrackerBots->RegisterBot(this);
+	}
 
-// Called every frame
-void ASTrackerBot::Tick(float DeltaTime)
+	//The wave waits on us until we die or go back to the pool
+	ASGameMode* GM = Cast<ASGameMode>(GetWorld()->GetAuthGameMode());
+	if (GM)
+	{
+		GM->RegisterLiveBot(this);
+	}
+}
+
+void ASTrackerBot::EnterPool()
 {
-	Super::Tick(DeltaTime);
+	bInPool = true;
 
-	if (!HasAuthority() || bExploded) return;
+	StopSteering();
 
+	ClearGameplayTimers();
 
-	float DistanceToTarget = (GetActorLocation() - NextPathPoint).Size();
+	//Parked bots aren't part of the wave, the health component counts us in again when we come back out
+	ASGameMode* GM = Cast<ASGameMode>(GetWorld()->GetAuthGameMode());
+	if (GM)
+	{
+		GM->UnregisterLiveBot(this);
+	}
 
-	if (DistanceToTarget <= RequiredDistanceToTarget)
+	//Not a target while parked
+	USTargetIndexSubsystem* TargetIndex = GetWorld()->GetSubsystem<USTargetIndexSubsystem>();
+	if (TargetIndex)
 	{
-		NextPathPoint = GetNextPathPoint();
+		TargetIndex->UnregisterTarget(this);
+	}
 
-		if (DebugTrackerBotDrawing)
-		{
-			DrawDebugString(GetWorld(), GetActorLocation(), "TargetReached");
-		}
+	SetActorHiddenInGame(true);
+	MeshComp->SetSimulatePhysics(false);
+	MeshComp->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+
+	PathPoints.Reset();
+	PathTarget = nullptr;
+}
+
+void ASTrackerBot::LeavePool(const FTransform& SpawnTransform)
+{
+	bInPool = false;
+
+	SetActorTransform(SpawnTransform, false, nullptr, ETeleportType::ResetPhysics);
+
+	ResetExplosionState();
+	SetActorHiddenInGame(false);
+
+	MeshComp->SetSimulatePhysics(true);
+	MeshComp->SetPhysicsLinearVelocity(FVector::ZeroVector);
+	MeshComp->SetPhysicsAngularVelocityInDegrees(FVector::ZeroVector);
+
+	HealthComp->ResetHealth();
+
+	//A request from the previous life may still be on its way, its result is simply replaced
+	bPathRequestPending = false;
+
+	PoolGeneration++;
+
+	StartHunting();
+}
+
+void ASTrackerBot::ReturnToPool()
+{
+	ASGameMode* GM = Cast<ASGameMode>(GetWorld()->GetAuthGameMode());
+	if (GM)
+	{
+		GM->ReleaseTrackerBot(this);
 	}
 	else
 	{
-		FVector ForceDirection = (NextPathPoint - GetActorLocation());
-		ForceDirection.Normalize();
+		Destroy();
+	}
+}
 
-		ForceDirection *= MovementForce;
+void ASTrackerBot::OnRep_PoolGeneration()
+{
+	ResetExplosionState();
+}
 
-		MeshComp->AddForce(ForceDirection, NAME_None, bUseVelocityChange);
+void ASTrackerBot::ResetExplosionState()
+{
+	bExploded = false;
+	bStartedSelfDestruction = false;
 
-		if (DebugTrackerBotDrawing)
-		{
-			DrawDebugDirectionalArrow(GetWorld(), GetActorLocation(), GetActorLocation() + ForceDirection,
-				32, FColor::Yellow, false, 0.0f, 0, 1.0f);
-		}
-	}
+	MeshComp->SetVisibility(true, true);
+	MeshComp->SetCollisionEnabled(ECollisionEnabled::QueryAndPhysics);
+}
 
-	if (DebugTrackerBotDrawing)
+void ASTrackerBot::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	StopSteering();
+	ClearGameplayTimers();
+
+	Super::EndPlay(EndPlayReason);
+}
+
+bool ASTrackerBot::IsDebugDrawingEnabled()
+{
+	return DebugTrackerBotDrawing > 0;
+}
+
+
+FVector ASTrackerBot::UpdateSteeringTarget(bool& bOutOnFlowField)
+{
+	//Steer from the targets flow field when we are on it, otherwise follow our own path
+	bOutOnFlowField = FollowFlowField();
+	return NextPathPoint;
+}
+
+void ASTrackerBot::OnPathPointReached()
+{
+	AdvancePath();
+
+	if (DebugTrackerBotDrawing && !bLowSignificance)
 	{
-		DrawDebugSphere(GetWorld(), NextPathPoint, 20, 12, FColor::Yellow, false, 4.0f, 1.0f);
+		DrawDebugString(GetWorld(), GetActorLocation(), "TargetReached");
 	}
 }
 
-FVector ASTrackerBot::GetNextPathPoint()
+bool ASTrackerBot::OnPathBlocked()
 {
-	AActor* BestTarget = nullptr;
-	float NearestTargetDistance = FLT_MAX;
+	if (bPathRequestPending)
+		return false;
+
+	PathPoints.Reset();
+	RepathIfNeeded();
+	return true;
+}
 
-	for (FConstPawnIterator It = GetWorld()->GetPawnIterator(); It; ++It)
+void ASTrackerBot::DrawSteeringDebug(const FVector& SteeringPoint, const FVector& Force) const
+{
+	if (!Force.IsZero())
 	{
-		APawn* TestPawn = It->Get();
-		if (TestPawn == nullptr || USHealthComponent::IsFriendly(TestPawn, this))
-		{
-			continue;
-		}
+		DrawDebugDirectionalArrow(GetWorld(), GetActorLocation(), GetActorLocation() + Force,
+			32, FColor::Yellow, false, 0.0f, 0, 1.0f);
+	}
 
-		USHealthComponent* TestPawnHealthComp = Cast<USHealthComponent>(TestPawn->GetComponentByClass(USHealthComponent::StaticClass()));
+	DrawDebugSphere(GetWorld(), SteeringPoint, 20, 12, FColor::Yellow, false, 4.0f, 1.0f);
+}
 
-		if (TestPawnHealthComp && TestPawnHealthComp->GetHealth() > 0.0f)
-		{
-			float Distance = (TestPawn->GetActorLocation() - GetActorLocation()).Size();
+void ASTrackerBot::RepathIfNeeded()
+{
+	if (bPathRequestPending)
+		return;
 
-			if (Distance < NearestTargetDistance)
-			{
-				BestTarget = TestPawn;
-				NearestTargetDistance = Distance;
-			}
-		}
+	//Nearest live hostile pawn, from the shared target index
+	USTargetIndexSubsystem* TargetIndex = GetWorld()->GetSubsystem<USTargetIndexSubsystem>();
+	AActor* BestTarget = TargetIndex ? TargetIndex->FindNearestTarget(GetActorLocation(), HealthComp->TeamNum) : nullptr;
+
+	if (!BestTarget)
+	{
+		//No target, wait here
+		PathPoints.Reset();
+		PathTarget = nullptr;
+		NextPathPoint = GetActorLocation();
+		return;
 	}
 
-	if (BestTarget)
+	AActor* PreviousTarget = PathTarget.Get();
+	PathTarget = BestTarget;
+
+	//Every bot chasing this target shares its flow field, no path of our own needed
+	if (FollowFlowField())
 	{
-		UNavigationPath* NavPath = UNavigationSystemV1::FindPathToActorSynchronously(this, GetActorLocation(), BestTarget);
+		PathPoints.Reset();
+		return;
+	}
 
-		GetWorldTimerManager().ClearTimer(TimerHandle_RefreshPath);
-		GetWorldTimerManager().SetTimer(TimerHandle_RefreshPath, this, &ASTrackerBot::RefreshPath, 5.0f, false);
+	//Current path still leads to the target
+	bool bPathValid = BestTarget == PreviousTarget && PathIndex < PathPoints.Num()
+		&& FVector::DistSquared(BestTarget->GetActorLocation(), PathTargetLocation) <= FMath::Square(RepathDistance);
 
-		if (NavPath && NavPath->PathPoints.Num() > 1)
+	if (bPathValid)
+		return;
+
+	//Pathfinding runs off the game thread, shared with other bots going the same way
+	USPathRequestSubsystem* PathRequests = GetWorld()->GetSubsystem<USPathRequestSubsystem>();
+	if (PathRequests)
+	{
+		bPathRequestPending = true;
+		PathTarget = BestTarget;
+		PathTargetLocation = BestTarget->GetActorLocation();
+
+		PathRequests->RequestPath(this, GetActorLocation(), BestTarget, FSPathFoundDelegate::CreateUObject(this, &ASTrackerBot::OnPathFound));
+
+		INC_DWORD_STAT(STAT_TrackerBotPathQueries);
+	}
+}
+
+void ASTrackerBot::OnPathFound(bool bSuccess, const TArray<FNavPathPoint>& NewPathPoints)
+{
+	bPathRequestPending = false;
+
+	PathPoints.Reset();
+	PathIndex = 0;
+
+	if (bSuccess && NewPathPoints.Num() > 1)
+	{
+		//Keep the whole path, the first point is where we are
+		for (int32 i = 1; i < NewPathPoints.Num(); i++)
 		{
-			//Return next point in path
-			return NavPath->PathPoints[1];
+			PathPoints.Add(NewPathPoints[i].Location);
 		}
+
+		NextPathPoint = PathPoints[0];
+	}
+	else
+	{
+		//Failed to find path
+		NextPathPoint = GetActorLocation();
+	}
+}
+
+void ASTrackerBot::AdvancePath()
+{
+	PathIndex++;
+
+	if (PathIndex < PathPoints.Num())
+	{
+		//Used to be a whole new path query
+		INC_DWORD_STAT(STAT_TrackerBotPathQueriesAvoided);
+
+		NextPathPoint = PathPoints[PathIndex];
+		return;
 	}
 
-	//Failed to find path
-	return GetActorLocation();
+	RepathIfNeeded();
+}
+
+bool ASTrackerBot::FollowFlowField()
+{
+	AActor* Target = PathTarget.Get();
+
+	USFlowFieldSubsystem* FlowFields = GetWorld()->GetSubsystem<USFlowFieldSubsystem>();
+	if (!Target || !FlowFields || !FlowFields->IsEnabled())
+		return false;
+
+	//Off the field, or it isn't built yet
+	FVector FlowPoint;
+	if (!FlowFields->SampleFlow(Target, GetActorLocation(), FlowPoint))
+		return false;
+
+	NextPathPoint = FlowPoint;
+	return true;
 }
 
 void ASTrackerBot::RefreshPath()
 {
-	NextPathPoint = GetNextPathPoint();
+	RepathIfNeeded();
 }
 
 void ASTrackerBot::SelfDestruct()
@@ -163,6 +361,8 @@ void ASTrackerBot::SelfDestruct()
 
 	bExploded = true;
 
+	StopSteering();
+
 	UGameplayStatics::SpawnEmitterAtLocation(GetWorld(), ExplosionEffect, GetActorLocation());
 	UGameplayStatics::PlaySoundAtLocation(this, ExplodeSound, GetActorLocation());
 
@@ -172,19 +372,83 @@ void ASTrackerBot::SelfDestruct()
 	//server only
 	if (!HasAuthority()) return;
 
-	TArray<AActor*> IgnoredActors;
-	IgnoredActors.Add(this);
-
-	//Apply Damage
-	UGameplayStatics::ApplyRadialDamage(this, ExplosionDamage, GetActorLocation(), ExplosionRadius, nullptr,
-		IgnoredActors, this, GetInstigatorController(), true);
+	//Apply Damage, batched with every other explosion this frame
+	USExplosionSubsystem* Explosions = GetWorld()->GetSubsystem<USExplosionSubsystem>();
+	if (Explosions)
+	{
+		Explosions->QueueExplosion(this, GetInstigatorController(), GetActorLocation(), ExplosionDamage, ExplosionRadius, nullptr, true);
+	}
 
 	if (DebugTrackerBotDrawing)
 	{
 		DrawDebugSphere(GetWorld(), GetActorLocation(), ExplosionRadius, 12, FColor::Red, false, 2.0f, 0, 1.0f);
 	}
 
-	SetLifeSpan(2.0f);
+	//Pooled bots are reused instead of destroyed
+	if (bPooled)
+	{
+		USGameplayTimerSubsystem* Timers = GetWorld()->GetSubsystem<USGameplayTimerSubsystem>();
+		if (Timers)
+		{
+			Timers->SetTimer<ASTrackerBot, &ASTrackerBot::ReturnToPool>(TimerHandle_ReturnToPool, this, ExplodedLifeSpan, false, ESGameplayTimerCategory::BotPool);
+		}
+	}
+	else
+	{
+		SetLifeSpan(ExplodedLifeSpan);
+	}
+}
+
+float ASTrackerBot::TakeDamage(float DamageAmount, FDamageEvent const& DamageEvent, AController* EventInstigator, AActor* DamageCauser)
+{
+	if (bInPool)
+		return 0.0f;
+
+	//Explosions throw us around, hand over to physics before the impulse is applied
+	if (HasAuthority() && DamageEvent.IsOfType(FRadialDamageEvent::ClassID))
+	{
+		USTrackerBotSubsystem* TrackerBots = GetWorld()->GetSubsystem<USTrackerBotSubsystem>();
+		if (TrackerBots)
+		{
+			TrackerBots->WakePhysics(this);
+		}
+	}
+
+	//Hits used to knock us back through the simulated body, carry the same push over to the kinematic velocity
+	if (HasAuthority() && DamageEvent.IsOfType(FPointDamageEvent::ClassID))
+	{
+		USTrackerBotSubsystem* TrackerBots = GetWorld()->GetSubsystem<USTrackerBotSubsystem>();
+		const UDamageType* DamageTypeCDO = DamageEvent.DamageTypeClass ? DamageEvent.DamageTypeClass->GetDefaultObject<UDamageType>() : GetDefault<UDamageType>();
+		if (TrackerBots && DamageTypeCDO->DamageImpulse > 0.0f)
+		{
+			const FPointDamageEvent& PointDamageEvent = static_cast<const FPointDamageEvent&>(DamageEvent);
+			const FVector Impulse = PointDamageEvent.ShotDirection.GetSafeNormal() * DamageTypeCDO->DamageImpulse;
+
+			TrackerBots->AddImpulse(this, Impulse, !DamageTypeCDO->bScaleMomentumByMass);
+		}
+	}
+
+	return Super::TakeDamage(DamageAmount, DamageEvent, EventInstigator, DamageCauser);
+}
+
+void ASTrackerBot::StopSteering()
+{
+	USTrackerBotSubsystem* TrackerBots = GetWorld()->GetSubsystem<USTrackerBotSubsystem>();
+	if (TrackerBots)
+	{
+		TrackerBots->UnregisterBot(this);
+	}
+}
+
+void ASTrackerBot::ClearGameplayTimers()
+{
+	USGameplayTimerSubsystem* Timers = GetWorld()->GetSubsystem<USGameplayTimerSubsystem>();
+	if (Timers)
+	{
+		Timers->ClearTimer(TimerHandle_RefreshPath);
+		Timers->ClearTimer(TimerHandle_SelfDamage);
+		Timers->ClearTimer(TimerHandle_ReturnToPool);
+	}
 }
 
 void ASTrackerBot::HandleTakeDamage(USHealthComponent* OwningHealthComp,
@@ -193,11 +457,12 @@ void ASTrackerBot::HandleTakeDamage(USHealthComponent* OwningHealthComp,
 {
 	//EXplode on health = 0
 
-	if (!MatInst)
-		MatInst = MeshComp->CreateAndSetMaterialInstanceDynamicFromMaterial(0, MeshComp->GetMaterial(0));
-	
-	if (MatInst)
-		MatInst->SetScalarParameterValue("LastTimeDamagetaken", GetWorld()->TimeSeconds);
+	//Pulse on dmg. Nothing to see on a dedicated server, or too far from anyone
+	if (GetNetMode() != NM_DedicatedServer && !bLowSignificance)
+	{
+		//Per primitive data, every bot keeps sharing the one material
+		MeshComp->SetCustomPrimitiveDataFloat(DamagePulseDataIndex, GetWorld()->TimeSeconds);
+	}
 
 	if (Health <= 0.0f)
 	{
@@ -207,28 +472,41 @@ void ASTrackerBot::HandleTakeDamage(USHealthComponent* OwningHealthComp,
 
 
 
-void ASTrackerBot::NotifyActorBeginOverlap(AActor* OtherActor)
+uint8 ASTrackerBot::GetTeamNum() const
+{
+	return HealthComp->TeamNum;
+}
+
+bool ASTrackerBot::OnHostileNearby(APawn* Hostile)
 {
-	Super::NotifyActorBeginOverlap(OtherActor);
+	if (bStartedSelfDestruction || bExploded || bInPool)
+		return false;
+
+	//Only players set us off
+	if (!Cast<ASCharacter>(Hostile) || USHealthComponent::IsFriendly(Hostile, this))
+		return false;
 
-	if (!bStartedSelfDestruction && !bExploded)
+	//Start self destruction sequence. First hit on the next timer tick, we are called from inside the bot subsystems update
+	USGameplayTimerSubsystem* Timers = GetWorld()->GetSubsystem<USGameplayTimerSubsystem>();
+	if (Timers)
 	{
-		ASCharacter* PlayerPawn = Cast<ASCharacter>(OtherActor);
-		if (PlayerPawn && !USHealthComponent::IsFriendly(OtherActor, this))
-		{
-			//We overlapped with player
+		Timers->SetTimer<ASTrackerBot, &ASTrackerBot::DamageSelf>(TimerHandle_SelfDamage, this, SelfDamageInterval, true, ESGameplayTimerCategory::BotSelfDamage, 0.0f);
+	}
 
-			if (HasAuthority())
-			{
-				//Start self destruction sequence
-				GetWorldTimerManager().SetTimer(TimerHandle_SelfDamage, this, &ASTrackerBot::DamageSelf, SelfDamageInterval, true, 0.0f);
-			}
+	bStartedSelfDestruction = true;
 
-			bStartedSelfDestruction = true;
+	//Clients hear it through replication
+	OnRep_SelfDestructStarted();
 
-			//play sound
-			UGameplayStatics::SpawnSoundAttached(SelfDestructSound, RootComponent);
-		}
+	return true;
+}
+
+void ASTrackerBot::OnRep_SelfDestructStarted()
+{
+	if (bStartedSelfDestruction)
+	{
+		//play sound
+		UGameplayStatics::SpawnSoundAttached(SelfDestructSound, RootComponent);
 	}
 }
 
@@ -236,3 +514,11 @@ void ASTrackerBot::DamageSelf()
 {
 	UGameplayStatics::ApplyDamage(this, 20, GetInstigatorController(), this, nullptr);
 }
+
+void ASTrackerBot::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	DOREPLIFETIME(ASTrackerBot, PoolGeneration);
+	DOREPLIFETIME(ASTrackerBot, bStartedSelfDestruction);
+}
@@ -4,6 +4,9 @@
 #include "Components/SHealthComponent.h"
 #include "Net/UnrealNetwork.h"
 #include "SGameMode.h"
+#include "GameFramework/Pawn.h"
+#include "Subsystems/SLagCompensationSubsystem.h"
+#include "Subsystems/STargetIndexSubsystem.h"
 
 // Sets default values for this component's properties
 USHealthComponent::USHealthComponent()
@@ -29,11 +32,52 @@ void USHealthComponent::BeginPlay()
 		{
 			MyOwner->OnTakeAnyDamage.AddDynamic(this, &USHealthComponent::HandleTakeAnyDamage);
 		}
+
+		//damageable pawns get their hitbox history recorded for lag compensation
+		USLagCompensationSubsystem* LagCompensation = GetWorld()->GetSubsystem<USLagCompensationSubsystem>();
+		if (LagCompensation)
+		{
+			LagCompensation->RegisterPawn(Cast<APawn>(MyOwner));
+		}
+
+		//live damageable pawns are targets for bots
+		USTargetIndexSubsystem* TargetIndex = GetWorld()->GetSubsystem<USTargetIndexSubsystem>();
+		if (TargetIndex)
+		{
+			TargetIndex->RegisterTarget(Cast<APawn>(MyOwner), TeamNum);
+		}
 	}
 
 	Health = DefaultHealth;
 }
 
+void USHealthComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	USLagCompensationSubsystem* LagCompensation = GetWorld()->GetSubsystem<USLagCompensationSubsystem>();
+	if (LagCompensation)
+	{
+		LagCompensation->UnregisterPawn(Cast<APawn>(GetOwner()));
+	}
+
+	USTargetIndexSubsystem* TargetIndex = GetWorld()->GetSubsystem<USTargetIndexSubsystem>();
+	if (TargetIndex)
+	{
+		TargetIndex->UnregisterTarget(Cast<APawn>(GetOwner()));
+	}
+
+	//Destroyed without dying, the wave shouldn't wait for us. Nothing to settle when the level is going away
+	if (EndPlayReason == EEndPlayReason::Destroyed)
+	{
+		ASGameMode* GM = Cast<ASGameMode>(GetWorld()->GetAuthGameMode());
+		if (GM)
+		{
+			GM->UnregisterLiveBot(Cast<APawn>(GetOwner()));
+		}
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
 void USHealthComponent::HandleTakeAnyDamage(AActor* DamagedActor, float Damage, const UDamageType* DamageType, AController* InstigatedBy, AActor* DamageCauser)
 {
 	if (Damage <= 0.0f || bIsDead)
@@ -55,6 +99,13 @@ void USHealthComponent::HandleTakeAnyDamage(AActor* DamagedActor, float Damage,
 
 	if (Health <= 0.0f)
 	{
+		//dead pawns are no longer targets
+		USTargetIndexSubsystem* TargetIndex = GetWorld()->GetSubsystem<USTargetIndexSubsystem>();
+		if (TargetIndex)
+		{
+			TargetIndex->UnregisterTarget(Cast<APawn>(GetOwner()));
+		}
+
 		ASGameMode* GM = Cast<ASGameMode>(GetWorld()->GetAuthGameMode());
 		if (GM)
 		{
@@ -83,6 +134,22 @@ void USHealthComponent::Heal(float HealAmount)
 	OnHealthChanged.Broadcast(this, Health, -HealAmount, nullptr, nullptr, nullptr);
 }
 
+void USHealthComponent::ResetHealth()
+{
+	if (GetOwnerRole() != ROLE_Authority)
+		return;
+
+	Health = DefaultHealth;
+	bIsDead = false;
+
+	//alive again, a target for bots
+	USTargetIndexSubsystem* TargetIndex = GetWorld()->GetSubsystem<USTargetIndexSubsystem>();
+	if (TargetIndex)
+	{
+		TargetIndex->RegisterTarget(Cast<APawn>(GetOwner()), TeamNum);
+	}
+}
+
 bool USHealthComponent::IsFriendly(AActor* ActorA, AActor* ActorB)
 {
 	if (ActorA == nullptr || ActorB == nullptr) 
@@ -10,6 +10,7 @@
 #include "../CoopGame.h"
 #include "SWeapon.h"
 #include "Net/UnrealNetwork.h"
+#include "SGameMode.h"
 
 // Sets default values
 ASCharacter::ASCharacter()
@@ -198,6 +199,21 @@ FVector ASCharacter::GetPawnViewLocation() const
 
 
 
+void ASCharacter::PossessedBy(AController* NewController)
+{
+	Super::PossessedBy(NewController);
+
+	//Driven by AI, an enemy the wave waits on until it dies
+	if (NewController && !NewController->IsPlayerController() && !bDied)
+	{
+		ASGameMode* GM = Cast<ASGameMode>(GetWorld()->GetAuthGameMode());
+		if (GM)
+		{
+			GM->RegisterLiveBot(this);
+		}
+	}
+}
+
 void ASCharacter::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
 {
 	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
@@ -6,24 +6,31 @@
 #include "Components/SHealthComponent.h"
 #include "SGameState.h"
 #include "SPlayerState.h"
+#include "AI/STrackerBot.h"
+#include "../CoopGame.h"
+
+
+DECLARE_CYCLE_STAT(TEXT("BotPool Spawn Actor"), STAT_BotPoolSpawn, STATGROUP_CoopGame);
+DECLARE_CYCLE_STAT(TEXT("BotPool Reuse"), STAT_BotPoolReuse, STATGROUP_CoopGame);
+DECLARE_DWORD_COUNTER_STAT(TEXT("BotPool Actors Spawned"), STAT_BotPoolActorsSpawned, STATGROUP_CoopGame);
+DECLARE_DWORD_COUNTER_STAT(TEXT("BotPool Bots Reused"), STAT_BotPoolBotsReused, STATGROUP_CoopGame);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("BotPool Idle Bots"), STAT_BotPoolIdleBots, STATGROUP_CoopGame);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Wave Live Bots"), STAT_WaveLiveBots, STATGROUP_CoopGame);
+
 
 ASGameMode::ASGameMode()
 {
 	TimeBetweenWaves = 2.0f;
 
-	GameStateClass = ASGameState::StaticClass();
-	PlayerStateClass = ASPlayerState::StaticClass();
+	MaxPooledBots = 64;
 
-	PrimaryActorTick.bCanEverTick = true;
-	PrimaryActorTick.TickInterval = 1.0f;
-}
+	bGameOver = false;
 
-void ASGameMode::Tick(float DeltaSeconds)
-{
-	Super::Tick(DeltaSeconds);
+	GameStateClass = ASGameState::StaticClass();
+	PlayerStateClass = ASPlayerState::StaticClass();
 
-	CheckWaveState();
-	CheckAnyPlayerAlive();
+	//Waves and game over are driven by spawns and deaths, nothing to poll
+	PrimaryActorTick.bCanEverTick = false;
 }
 
 
@@ -48,6 +55,9 @@ void ASGameMode::SpawnBotTimerElapsed()
 	if (NumBotsToSpawn <= 0)
 	{
 		EndWave();
+
+		//Everything may already be dead, or the hook spawned nothing
+		CheckWaveState();
 	}
 }
 
@@ -68,20 +78,44 @@ void ASGameMode::PrepareForNextWave()
 	SetWaveState(EWaveState::WaitingToStart);
 
 	RestartDeadPlayers();
+
+	//Next wave spawns 2 * its wave number
+	PrewarmTrackerBots(2 * (WaveCount + 1));
 }
 
 void ASGameMode::CheckWaveState()
 {
 	bool bIsPreparingForWave = GetWorldTimerManager().IsTimerActive(TimerHandle_NextWaveStart);
-	if (NumBotsToSpawn > 0 || bIsPreparingForWave) return;
+	if (NumBotsToSpawn > 0 || bIsPreparingForWave || bGameOver) return;
+
+
+#if DO_CHECK
+	VerifyLiveBotCount();
+#endif
+
+	if (LiveBots.Num() == 0)
+	{
+		SetWaveState(EWaveState::WaveComplete);
 
+		PrepareForNextWave();
+	}
+}
 
-	bool bIsAnyBotAlive = false;
+void ASGameMode::VerifyLiveBotCount() const
+{
+	int32 NumAlive = 0;
 
 	for (FConstPawnIterator It = GetWorld()->GetPawnIterator(); It; ++It)
 	{
 		APawn* TestPawn = It->Get();
-		if (TestPawn == nullptr || TestPawn->IsPlayerControlled())
+		if (TestPawn == nullptr || TestPawn->IsPlayerControlled() || TestPawn->IsActorBeingDestroyed())
+		{
+			continue;
+		}
+
+		//Idle pooled bots aren't part of the wave, and only tracker bots count without an AI controlling them
+		ASTrackerBot* TrackerBot = Cast<ASTrackerBot>(TestPawn);
+		if (TrackerBot ? TrackerBot->IsInPool() : TestPawn->GetController() == nullptr)
 		{
 			continue;
 		}
@@ -90,50 +124,153 @@ void ASGameMode::CheckWaveState()
 
 		if (HealthComp && HealthComp->GetHealth() > 0.0f)
 		{
-			bIsAnyBotAlive = true;
-			break;
+			NumAlive++;
 		}
 	}
 
-	if (!bIsAnyBotAlive)
+	ensureMsgf(NumAlive == LiveBots.Num(), TEXT("Live bot count is %d but %d bots are alive in the world"), LiveBots.Num(), NumAlive);
+}
+
+void ASGameMode::RegisterLiveBot(APawn* Bot)
+{
+	if (!Bot)
+		return;
+
+	LiveBots.Add(Bot);
+
+	SET_DWORD_STAT(STAT_WaveLiveBots, LiveBots.Num());
+}
+
+void ASGameMode::UnregisterLiveBot(APawn* Bot)
+{
+	if (LiveBots.Remove(Bot) == 0)
+		return;
+
+	SET_DWORD_STAT(STAT_WaveLiveBots, LiveBots.Num());
+
+	if (LiveBots.Num() == 0)
 	{
-		SetWaveState(EWaveState::WaveComplete);
+		CheckWaveState();
+	}
+}
 
-		PrepareForNextWave();
+void ASGameMode::HandleActorKilled(AActor* VictimActor, AActor* KillerActor, AController* KillerController)
+{
+	APawn* VictimPawn = Cast<APawn>(VictimActor);
+	if (!VictimPawn)
+		return;
+
+	if (LiveBots.Contains(VictimPawn))
+	{
+		UnregisterLiveBot(VictimPawn);
+	}
+	else if (AlivePlayers.Contains(VictimPawn))
+	{
+		SetPlayerDead(VictimPawn);
 	}
+}
 
+void ASGameMode::RestartPlayer(AController* NewPlayer)
+{
+	Super::RestartPlayer(NewPlayer);
 
+	if (NewPlayer && NewPlayer->IsPlayerController() && NewPlayer->GetPawn())
+	{
+		SetPlayerAlive(NewPlayer, NewPlayer->GetPawn());
+	}
 }
 
-void ASGameMode::CheckAnyPlayerAlive()
+void ASGameMode::Logout(AController* Exiting)
 {
+	Super::Logout(Exiting);
 
-	for (FConstPlayerControllerIterator It = GetWorld()->GetPlayerControllerIterator(); It; It++)
+	DeadPlayers.Remove(Exiting);
+
+	//Leaving while alive is like dying, the rest of the team may have been waiting on us
+	APawn* AlivePawn = nullptr;
+	for (const TPair<TWeakObjectPtr<APawn>, TWeakObjectPtr<AController>>& Pair : AlivePlayers)
 	{
-		APlayerController* PC = It->Get();
-		if (PC && PC->GetPawn())
+		if (Pair.Value == Exiting)
 		{
-			APawn* MyPawn = PC->GetPawn();
-			USHealthComponent* HealthComp = Cast<USHealthComponent>(MyPawn->GetComponentByClass(USHealthComponent::StaticClass()));
-
-			//if this check fails it will create a break point and break
-			if (ensure(HealthComp) && HealthComp->GetHealth() > 0.0f)
-			{
-				// A Player is still alive
-				return;
-			}
+			AlivePawn = Pair.Key.Get();
+			break;
 		}
 	}
 
-	//No player alive
-	GameOver();
+	if (AlivePawn)
+	{
+		SetPlayerDead(AlivePawn);
+		DeadPlayers.Remove(Exiting);
+	}
 
+	UpdatePlayerCounts();
+}
+
+void ASGameMode::SetPlayerAlive(AController* Player, APawn* PlayerPawn)
+{
+	//One pawn per player
+	for (auto It = AlivePlayers.CreateIterator(); It; ++It)
+	{
+		if (It->Value == Player)
+		{
+			It.RemoveCurrent();
+		}
+	}
+
+	DeadPlayers.Remove(Player);
+	AlivePlayers.Add(PlayerPawn, Player);
+
+	//Destroyed without dying, falling out of the world for one
+	PlayerPawn->OnDestroyed.AddUniqueDynamic(this, &ASGameMode::HandlePlayerPawnDestroyed);
+
+	UpdatePlayerCounts();
+}
+
+void ASGameMode::SetPlayerDead(APawn* PlayerPawn)
+{
+	TWeakObjectPtr<AController> Player;
+	if (!AlivePlayers.RemoveAndCopyValue(PlayerPawn, Player))
+		return;
+
+	if (Player.IsValid())
+	{
+		DeadPlayers.Add(Player);
+	}
+
+	UpdatePlayerCounts();
+
+	if (AlivePlayers.Num() == 0)
+	{
+		GameOver();
+	}
+}
+
+void ASGameMode::HandlePlayerPawnDestroyed(AActor* DestroyedActor)
+{
+	SetPlayerDead(Cast<APawn>(DestroyedActor));
+}
+
+void ASGameMode::UpdatePlayerCounts()
+{
+	ASGameState* GS = GetGameState<ASGameState>();
+	if (GS)
+	{
+		GS->SetPlayerCounts(AlivePlayers.Num(), DeadPlayers.Num());
+	}
 }
 
 void ASGameMode::GameOver()
 {
+	if (bGameOver)
+		return;
+
+	bGameOver = true;
+
 	EndWave();
 
+	//No more waves after this
+	GetWorldTimerManager().ClearTimer(TimerHandle_NextWaveStart);
+
 	//TODO: Finish up match and present game over to players
 
 	SetWaveState(EWaveState::GameOver);
@@ -168,7 +305,89 @@ void ASGameMode::StartPlay()
 {
 	Super::StartPlay();
 
+	OnActorKilled.AddDynamic(this, &ASGameMode::HandleActorKilled);
+
 	PrepareForNextWave();
 }
 
 
+
+void ASGameMode::PrewarmTrackerBots(int32 Count)
+{
+	if (!TrackerBotClass)
+		return;
+
+	Count = FMath::Min(Count, MaxPooledBots);
+
+	while (PooledBots.Num() < Count)
+	{
+		ASTrackerBot* Bot = SpawnPooledBot(GetActorTransform());
+		if (!Bot)
+			break;
+
+		Bot->EnterPool();
+		PooledBots.Add(Bot);
+	}
+
+	SET_DWORD_STAT(STAT_BotPoolIdleBots, PooledBots.Num());
+}
+
+ASTrackerBot* ASGameMode::SpawnPooledBot(const FTransform& SpawnTransform)
+{
+	SCOPE_CYCLE_COUNTER(STAT_BotPoolSpawn);
+
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+	ASTrackerBot* Bot = GetWorld()->SpawnActor<ASTrackerBot>(TrackerBotClass, SpawnTransform, SpawnParams);
+	if (Bot)
+	{
+		Bot->SetPooled(true);
+
+		INC_DWORD_STAT(STAT_BotPoolActorsSpawned);
+	}
+
+	return Bot;
+}
+
+ASTrackerBot* ASGameMode::SpawnTrackerBot(const FTransform& SpawnTransform)
+{
+	//Drop any bots destroyed while idle
+	while (PooledBots.Num() > 0)
+	{
+		ASTrackerBot* Bot = PooledBots.Pop(false);
+		if (!IsValid(Bot))
+			continue;
+
+		SCOPE_CYCLE_COUNTER(STAT_BotPoolReuse);
+
+		Bot->LeavePool(SpawnTransform);
+
+		INC_DWORD_STAT(STAT_BotPoolBotsReused);
+		SET_DWORD_STAT(STAT_BotPoolIdleBots, PooledBots.Num());
+		return Bot;
+	}
+
+	if (!TrackerBotClass)
+		return nullptr;
+
+	//Pool ran dry, pay for a new one
+	return SpawnPooledBot(SpawnTransform);
+}
+
+void ASGameMode::ReleaseTrackerBot(ASTrackerBot* Bot)
+{
+	if (!Bot || Bot->IsInPool())
+		return;
+
+	if (PooledBots.Num() >= MaxPooledBots)
+	{
+		Bot->Destroy();
+		return;
+	}
+
+	Bot->EnterPool();
+	PooledBots.Add(Bot);
+
+	SET_DWORD_STAT(STAT_BotPoolIdleBots, PooledBots.Num());
+}
@@ -25,6 +25,29 @@ void ASGameState::SetWaveState(EWaveState NewState)
 }
 
 
+//client called automatically when either count changed
+void ASGameState::OnRep_PlayerCounts()
+{
+	PlayerCountsChanged(NumPlayersAlive, NumPlayersDead); //BP Implementable
+}
+
+void ASGameState::SetPlayerCounts(int32 Alive, int32 Dead)
+{
+	if (HasAuthority())
+	{
+		const uint8 NewAlive = (uint8)FMath::Clamp(Alive, 0, 255);
+		const uint8 NewDead = (uint8)FMath::Clamp(Dead, 0, 255);
+		if (NewAlive == NumPlayersAlive && NewDead == NumPlayersDead)
+			return;
+
+		NumPlayersAlive = NewAlive;
+		NumPlayersDead = NewDead;
+
+		//Call on Server
+		OnRep_PlayerCounts();
+	}
+}
+
 
 void ASGameState::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
 {
@@ -32,4 +55,6 @@ void ASGameState::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifet
 
 
 	DOREPLIFETIME(ASGameState, WaveState); //Replicated variable to all machines
+	DOREPLIFETIME(ASGameState, NumPlayersAlive);
+	DOREPLIFETIME(ASGameState, NumPlayersDead);
 }
\ No newline at end of file
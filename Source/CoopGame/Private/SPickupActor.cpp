@@ -2,7 +2,6 @@
 
 
 #include "SPickupActor.h"
-#include "TimerManager.h"
 #include "SPowerupActor.h"
 #include "Components/SphereComponent.h"
 #include "Components/DecalComponent.h"
@@ -64,7 +63,11 @@ void ASPickupActor::NotifyActorBeginOverlap(AActor* OtherActor)
 		PowerupInstance = nullptr;
 
 		//Set Timer to respawn
-		GetWorldTimerManager().SetTimer(TimerHandle_RespawnTimer, this, &ASPickupActor::Respawn, CooldownDuration);
+		USGameplayTimerSubsystem* Timers = GetWorld()->GetSubsystem<USGameplayTimerSubsystem>();
+		if (Timers)
+		{
+			Timers->SetTimer<ASPickupActor, &ASPickupActor::Respawn>(TimerHandle_RespawnTimer, this, CooldownDuration, false, ESGameplayTimerCategory::PickupRespawn);
+		}
 	}
 }
 
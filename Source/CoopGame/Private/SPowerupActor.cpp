@@ -30,7 +30,11 @@ void ASPowerupActor::OnTickPowerup()
 		OnRep_PowerupActive(); //call rep function for the server as well
 
 		//Reset Timer
-		GetWorldTimerManager().ClearTimer(TimerHandle_PowerupTick);
+		USGameplayTimerSubsystem* Timers = GetWorld()->GetSubsystem<USGameplayTimerSubsystem>();
+		if (Timers)
+		{
+			Timers->ClearTimer(TimerHandle_PowerupTick);
+		}
 	}
 }
 
@@ -49,8 +53,9 @@ void ASPowerupActor::ActivatePowerup(AActor* ActivateFor)
 	OnRep_PowerupActive(); //call rep function for the server as well
 
 	//activate powerup for time
-	if (PowerupInterval > 0.0f)
-		GetWorldTimerManager().SetTimer(TimerHandle_PowerupTick, this, &ASPowerupActor::OnTickPowerup, PowerupInterval, true);
+	USGameplayTimerSubsystem* Timers = GetWorld()->GetSubsystem<USGameplayTimerSubsystem>();
+	if (PowerupInterval > 0.0f && Timers)
+		Timers->SetTimer<ASPowerupActor, &ASPowerupActor::OnTickPowerup>(TimerHandle_PowerupTick, this, PowerupInterval, true, ESGameplayTimerCategory::Powerup);
 	else
 		OnTickPowerup();
 }
@@ -3,9 +3,61 @@
 
 #include "SProjectileWeapon.h"
 #include "Kismet/GameplayStatics.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/PlayerState.h"
+
+
+static int32 PredictedProjectiles = 1;
+FAutoConsoleVariableRef CVARPredictedProjectiles(
+	TEXT("COOP.PredictedProjectiles"),
+	PredictedProjectiles,
+	TEXT("Owning clients launch their projectiles right away and reconcile them with the servers. Needs COOP.WeaponFireStateMode"),
+	ECVF_Default);
+
+//Furthest the server will fast forward a clients projectile, same as the lag compensation default
+static const float MaxProjectileFastForward = 0.3f;
+
 
 void ASProjectileWeapon::Fire()
 {
+	FireProjectile(0.0f);
+}
+
+void ASProjectileWeapon::FireBatch(int32 NumShots, float OldestShotAge)
+{
+	//Clients only, when not in fire state mode. These are not predicted
+	if (!HasAuthority() && !UseFireStateReplication())
+	{
+		for (int32 i = 0; i < NumShots; i++)
+		{
+			ServerFire(GetServerWorldTime() - (OldestShotAge - i * TimeBetweenShots));
+		}
+	}
+
+	for (int32 i = 0; i < NumShots; i++)
+	{
+		FireProjectile(OldestShotAge - i * TimeBetweenShots);
+	}
+
+	LastFireTime = GetWorld()->TimeSeconds - (OldestShotAge - (NumShots - 1) * TimeBetweenShots);
+}
+
+void ASProjectileWeapon::FireProjectile(float FastForward)
+{
+	const uint16 PredictionId = GetPredictionId();
+	BurstShotCount++;
+
+	USProjectileSubsystem* Projectiles = GetWorld()->GetSubsystem<USProjectileSubsystem>();
+	const bool bSimulated = Projectiles && Projectiles->IsEnabled();
+
+	//Clients only launch their own predicted copy, the server fires the real one from the replicated fire state
+	if (!HasAuthority())
+	{
+		bool bPredict = bSimulated && PredictedProjectiles > 0 && UseFireStateReplication();
+		if (!bPredict)
+			return;
+	}
+
 	AActor* MyOwner = GetOwner();
 	if (MyOwner && ProjectileClass)
 	{
@@ -15,9 +67,68 @@ void ASProjectileWeapon::Fire()
 
 		FVector MuzzleLocation = MeshComp->GetSocketLocation(MuzzleSocketName);
 
+		//Simulated as data, no actor per projectile
+		if (bSimulated)
+		{
+			FVector Velocity = EyeRotation.Vector() * ProjectileParams.LaunchSpeed;
+
+			if (!HasAuthority())
+			{
+				Projectiles->LaunchProjectile(this, MuzzleLocation, Velocity, true, FastForward, PredictionId);
+				return;
+			}
+
+			//Catch up to where the owning client already shows its predicted projectile
+			float ServerFastForward = FastForward + GetOwnerHalfRoundTrip();
+
+			Projectiles->LaunchProjectile(this, MuzzleLocation, Velocity, false, ServerFastForward);
+
+			MulticastLaunchProjectile(MuzzleLocation, Velocity, PredictionId);
+			return;
+		}
+
 		FActorSpawnParameters ActorSpawnParams;
 		ActorSpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
 
 		GetWorld()->SpawnActor<AActor>(ProjectileClass, MuzzleLocation, EyeRotation, ActorSpawnParams);
 	}
 }
+
+uint16 ASProjectileWeapon::GetPredictionId() const
+{
+	return (uint16)(SpreadStream.GetInitialSeed() * 31 + BurstShotCount);
+}
+
+float ASProjectileWeapon::GetOwnerHalfRoundTrip() const
+{
+	APawn* MyOwner = Cast<APawn>(GetOwner());
+	if (!MyOwner || MyOwner->IsLocallyControlled() || !MyOwner->GetPlayerState())
+		return 0.0f;
+
+	return FMath::Min(MyOwner->GetPlayerState()->ExactPing * 0.0005f, MaxProjectileFastForward);
+}
+
+void ASProjectileWeapon::MulticastLaunchProjectile_Implementation(FVector_NetQuantize Location, FVector_NetQuantize Velocity, uint16 PredictionId)
+{
+	//Server already has the real one
+	if (HasAuthority())
+		return;
+
+	USProjectileSubsystem* Projectiles = GetWorld()->GetSubsystem<USProjectileSubsystem>();
+	if (!Projectiles)
+		return;
+
+	APawn* MyOwner = Cast<APawn>(GetOwner());
+	if (MyOwner && MyOwner->IsLocallyControlled() && PredictedProjectiles > 0 && UseFireStateReplication())
+	{
+		//The server launched it half a round trip ahead, and this took another half to arrive
+		APlayerState* PS = MyOwner->GetPlayerState();
+		float FastForward = PS ? FMath::Min(PS->ExactPing * 0.001f, MaxProjectileFastForward * 2.0f) : 0.0f;
+
+		//Already exploded on our side if it doesn't match, don't show it twice
+		Projectiles->ReconcileProjectile(this, PredictionId, Location, Velocity, FastForward);
+		return;
+	}
+
+	Projectiles->LaunchProjectile(this, Location, Velocity, true);
+}
@@ -11,6 +11,11 @@
 #include "../CoopGame.h"
 #include "Net/UnrealNetwork.h"
 #include "TimerManager.h"
+#include "GameFramework/GameStateBase.h"
+#include "Subsystems/SLagCompensationSubsystem.h"
+#include "Subsystems/SWeaponTraceSubsystem.h"
+#include "Subsystems/SWeaponFXSubsystem.h"
+#include "Subsystems/SWeakspotSubsystem.h"
 
 
 //Created a console variable. Global
@@ -21,6 +26,177 @@ FAutoConsoleVariableRef CVARDebugWeaponDrawing(
 	TEXT("Draw Debug Lines for Weapons"), 
 	ECVF_Cheat);
 
+static int32 WeaponFireStateMode = 1;
+FAutoConsoleVariableRef CVARWeaponFireStateMode(
+	TEXT("COOP.WeaponFireStateMode"),
+	WeaponFireStateMode,
+	TEXT("Clients send only start/stop fire and a spread seed, the server regenerates the shots. 0 sends an RPC per shot"),
+	ECVF_Default);
+
+//Most shots the server will fire to catch up with a client when its stop fire arrives
+static const int32 MaxCatchUpShots = 3;
+
+//Most shots fired in a single frame
+static const int32 MaxShotsPerFrame = 16;
+
+//Endpoints are sent relative to the muzzle, each component in this many bits
+static const int32 HitScanComponentBits = 14;
+//Units per quantization step. 14 bits at 2 units covers +-16k, more than the 10000 unit trace
+static const float HitScanQuantizeStep = 2.0f;
+
+
+FHitScanTrace::FHitScanTrace()
+	: ShotCounter(0)
+	, NumShots(0)
+	, NumPendingShots(0)
+	, Origin(ForceInitToZero)
+{
+	FMemory::Memzero(Shots);
+}
+
+void FHitScanTrace::AddShot(const FVector& MuzzleLocation, const FVector& TraceTo, EPhysicalSurface SurfaceType)
+{
+	FHitScanShot& Shot = Shots[ShotCounter % HITSCAN_HISTORY_SIZE];
+	Shot.TraceTo = TraceTo;
+	Shot.SurfaceType = SurfaceType;
+
+	Origin = MuzzleLocation;
+
+	ShotCounter++;
+	NumPendingShots = (uint8)FMath::Min(NumPendingShots + 1, HITSCAN_HISTORY_SIZE);
+}
+
+void FHitScanTrace::PrepareNetUpdate()
+{
+	NumShots = NumPendingShots;
+	NumPendingShots = 0;
+}
+
+bool FHitScanTrace::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess)
+{
+	uint32 Counter = ShotCounter;
+	Ar.SerializeInt(Counter, 256);
+
+	uint32 Num = NumShots;
+	Ar.SerializeInt(Num, HITSCAN_HISTORY_SIZE + 1);
+
+	bOutSuccess = SerializePackedVector<1, 20>(Origin, Ar);
+
+	if (Ar.IsLoading())
+	{
+		ShotCounter = (uint8)Counter;
+		NumShots = (uint8)FMath::Min<uint32>(Num, HITSCAN_HISTORY_SIZE);
+	}
+
+	const int32 QuantizeOffset = 1 << (HitScanComponentBits - 1);
+
+	for (int32 i = 0; i < NumShots; i++)
+	{
+		FHitScanShot& Shot = Shots[GetSentShotSlot(i)];
+
+		uint32 Packed[3] = { 0, 0, 0 };
+		uint32 Surface = Shot.SurfaceType;
+
+		if (Ar.IsSaving())
+		{
+			const FVector Delta = (Shot.TraceTo - Origin) / HitScanQuantizeStep;
+			for (int32 Axis = 0; Axis < 3; Axis++)
+			{
+				Packed[Axis] = FMath::Clamp(FMath::RoundToInt(Delta[Axis]) + QuantizeOffset, 0, (QuantizeOffset * 2) - 1);
+			}
+		}
+
+		for (int32 Axis = 0; Axis < 3; Axis++)
+		{
+			Ar.SerializeInt(Packed[Axis], 1 << HitScanComponentBits);
+		}
+
+		//6 bits covers every surface type
+		Ar.SerializeInt(Surface, SurfaceType_Max);
+
+		if (Ar.IsLoading())
+		{
+			FVector Delta;
+			for (int32 Axis = 0; Axis < 3; Axis++)
+			{
+				Delta[Axis] = ((int32)Packed[Axis] - QuantizeOffset) * HitScanQuantizeStep;
+			}
+
+			Shot.TraceTo = Origin + Delta;
+			Shot.SurfaceType = (EPhysicalSurface)Surface;
+		}
+	}
+
+	bOutSuccess &= !Ar.IsError();
+	return true;
+}
+
+FPelletTrace::FPelletTrace()
+	: PatternCounter(0)
+	, NumPatterns(0)
+	, NumPendingPatterns(0)
+{
+	FMemory::Memzero(Patterns);
+}
+
+void FPelletTrace::AddPattern(const FPelletPattern& Pattern)
+{
+	Patterns[PatternCounter % PELLET_HISTORY_SIZE] = Pattern;
+
+	PatternCounter++;
+	NumPendingPatterns = (uint8)FMath::Min(NumPendingPatterns + 1, PELLET_HISTORY_SIZE);
+}
+
+void FPelletTrace::PrepareNetUpdate()
+{
+	NumPatterns = NumPendingPatterns;
+	NumPendingPatterns = 0;
+}
+
+bool FPelletTrace::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess)
+{
+	uint32 Counter = PatternCounter;
+	Ar.SerializeInt(Counter, 256);
+
+	uint32 Num = NumPatterns;
+	Ar.SerializeInt(Num, PELLET_HISTORY_SIZE + 1);
+
+	if (Ar.IsLoading())
+	{
+		PatternCounter = (uint8)Counter;
+		NumPatterns = (uint8)FMath::Min<uint32>(Num, PELLET_HISTORY_SIZE);
+	}
+
+	bOutSuccess = true;
+
+	for (int32 i = 0; i < NumPatterns; i++)
+	{
+		FPelletPattern& Pattern = Patterns[GetSentPatternSlot(i)];
+
+		bOutSuccess &= SerializePackedVector<1, 20>(Pattern.Origin, Ar);
+		bOutSuccess &= SerializeFixedVector<1, 16>(Pattern.AimDirection, Ar);
+
+		Ar << Pattern.Seed;
+
+		uint32 Pellets = Pattern.NumPellets;
+		Ar.SerializeInt(Pellets, MAX_PELLETS + 1);
+
+		//One bit per pellet
+		uint32 HitMask = Pattern.HitMask;
+		Ar.SerializeInt(HitMask, 1u << FMath::Clamp<uint32>(Pellets, 1, MAX_PELLETS));
+
+		if (Ar.IsLoading())
+		{
+			Pattern.NumPellets = (uint8)Pellets;
+			Pattern.HitMask = (uint16)HitMask;
+		}
+	}
+
+	bOutSuccess &= !Ar.IsError();
+	return true;
+}
+
+
 // Sets default values
 ASWeapon::ASWeapon()
 {
@@ -35,8 +211,22 @@ ASWeapon::ASWeapon()
 
 	BulletSpread = 1.0f;
 
+	PelletsPerShot = 1;
+
+	PelletSpread = 5.0f;
+
 	RateOfFire = 600;
 
+	LagCompensationTimestamp = -1.0f;
+
+	BurstStartTimestamp = -1.0f;
+
+	FireAccumulator = 0.0f;
+
+	//Ticks only while the trigger is held, to drive the fire accumulator
+	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.bStartWithTickEnabled = false;
+
 	SetReplicates(true); //when spawned on server, will also spawn on clients
 
 	NetUpdateFrequency = 66.0f;
@@ -53,12 +243,59 @@ void ASWeapon::BeginPlay()
 
 
 
+void ASWeapon::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	FireAccumulator += DeltaTime;
+
+	ConsumeFireAccumulator();
+}
+
+//Fires every shot owed since the last frame as one batch
+void ASWeapon::ConsumeFireAccumulator()
+{
+	if (TimeBetweenShots <= 0.0f)
+		return;
+
+	int32 ShotsOwed = FMath::FloorToInt(FireAccumulator / TimeBetweenShots);
+	if (ShotsOwed <= 0)
+		return;
+
+	//After a long hitch drop the shots we can't catch up on, instead of firing a huge burst
+	if (ShotsOwed > MaxShotsPerFrame)
+	{
+		FireAccumulator = MaxShotsPerFrame * TimeBetweenShots + FMath::Fmod(FireAccumulator, TimeBetweenShots);
+		ShotsOwed = MaxShotsPerFrame;
+	}
+
+	//The oldest owed shot was due this long ago
+	float OldestShotAge = FireAccumulator - TimeBetweenShots;
+
+	FireAccumulator -= ShotsOwed * TimeBetweenShots;
+
+	FireBatch(ShotsOwed, OldestShotAge);
+}
+
 void ASWeapon::Fire()
 {
-	//Clients only
-	if (!HasAuthority())
-		ServerFire();
+	FireBatch(1, 0.0f);
+}
 
+void ASWeapon::FireBatch(int32 NumShots, float OldestShotAge)
+{
+	const float Now = GetWorld()->TimeSeconds;
+
+	//Clients only, when not in fire state mode. Send the server time we fired at so the server can rewind to what we saw
+	if (!HasAuthority() && WeaponFireStateMode <= 0)
+	{
+		for (int32 i = 0; i < NumShots; i++)
+		{
+			ServerFire(GetServerWorldTime() - (OldestShotAge - i * TimeBetweenShots));
+		}
+	}
+
+	LastFireTime = Now - (OldestShotAge - (NumShots - 1) * TimeBetweenShots);
 
 	//Trace the world, from pawn eyes to crosshair location
 	AActor* MyOwner = GetOwner();
@@ -69,80 +306,304 @@ void ASWeapon::Fire()
 	FRotator EyeRotation;
 	MyOwner->GetActorEyesViewPoint(EyeLocation, EyeRotation); //Fill passed variables for use
 
-	FVector ShotDirection = EyeRotation.Vector();
-
 	float HalfRad = FMath::DegreesToRadians(BulletSpread);
-	ShotDirection = FMath::VRandCone(ShotDirection, HalfRad, HalfRad);
 
-	FVector TraceEnd = EyeLocation + (ShotDirection * 10000); //Trace an end location
+	USWeaponTraceSubsystem* TraceQueue = GetWorld()->GetSubsystem<USWeaponTraceSubsystem>();
+	bool bQueueShots = TraceQueue && TraceQueue->IsEnabled();
+
+	TArray<FSWeaponShot, TInlineAllocator<MAX_PELLETS>> Shots;
+
+	for (int32 i = 0; i < NumShots; i++)
+	{
+		FVector ShotDirection = SpreadStream.VRandCone(EyeRotation.Vector(), HalfRad, HalfRad);
+
+		FSWeaponShot Shot;
+		Shot.TraceStart = EyeLocation;
+		Shot.TraceEnd = EyeLocation + (ShotDirection * 10000); //Trace an end location
+		Shot.ShotDirection = ShotDirection;
+		Shot.LagCompensationTimestamp = LagCompensationTimestamp;
 
-	//Collision Paramaters
-	FCollisionQueryParams QueryParams;
-	QueryParams.AddIgnoredActor(MyOwner);
-	QueryParams.AddIgnoredActor(this);
-	QueryParams.bTraceComplex = true; //Does very specific tracing (more expensive). So we can calculate headshots
-	QueryParams.bReturnPhysicalMaterial = true; //get data on what type of material hit
+		//Server regenerating a clients burst, rewind to when the client fired this shot
+		if (bRemoteBurst)
+		{
+			Shot.LagCompensationTimestamp = BurstStartTimestamp + BurstShotCount * TimeBetweenShots;
+		}
 
-	// Particle "Target" parameter 
-	FVector TracerEndPoint = TraceEnd;
+		BurstShotCount++;
 
-	EPhysicalSurface SurfaceType = SurfaceType_Default;
-		
-	FHitResult Hit;
-	//if blocking collision calculated
-	if (GetWorld()->LineTraceSingleByChannel(Hit, EyeLocation, TraceEnd, COLLISION_WEAPON, QueryParams))
+		if (PelletsPerShot > 1)
+		{
+			//One seed per pattern, remote clients regenerate the pellets from it
+			Shot.PelletSeed = SpreadStream.RandRange(1, MAX_int32 - 1);
+
+			FRandomStream PelletStream(Shot.PelletSeed);
+			for (int32 Pellet = 0; Pellet < FMath::Min(PelletsPerShot, MAX_PELLETS); Pellet++)
+			{
+				Shot.PelletIndex = (uint8)Pellet;
+				Shot.TraceEnd = EyeLocation + (GetPelletDirection(PelletStream, ShotDirection) * 10000);
+				Shots.Add(Shot);
+			}
+		}
+		else
+		{
+			Shots.Add(Shot);
+		}
+	}
+
+	//Trace with the rest of this frames shots, resolved next frame
+	if (bQueueShots)
 	{
-		AActor* HitActor = Hit.GetActor();
+		for (const FSWeaponShot& Shot : Shots)
+		{
+			TraceQueue->QueueShot(this, Shot);
+		}
+	}
+	else
+	{
+		TraceShots(Shots);
+	}
+}
 
-		// Select the proper impact effect and play it
-		SurfaceType = UPhysicalMaterial::DetermineSurfaceType(Hit.PhysMaterial.Get());
+FVector ASWeapon::GetPelletDirection(FRandomStream& PelletStream, const FVector& AimDirection) const
+{
+	float HalfRad = FMath::DegreesToRadians(PelletSpread);
+	return PelletStream.VRandCone(AimDirection, HalfRad, HalfRad);
+}
+
+void ASWeapon::TraceShots(TArrayView<const FSWeaponShot> Shots)
+{
+	TArray<FSWeaponShotResult, TInlineAllocator<MAX_PELLETS>> Results;
 
-		//Set Damage Amount
-		float ActualDamage = BaseDamage;
-		if (SurfaceType == SURFACE_FLESHVULNERABLE)
-			ActualDamage *= 4.0f;
-			
-		//Apply Damage to hit Actor
-		UGameplayStatics::ApplyPointDamage(HitActor, ActualDamage, ShotDirection, Hit, 
-			MyOwner->GetInstigatorController(), MyOwner, DamageType);
-			
-		PlayImpactEffects(SurfaceType, Hit.ImpactPoint);
+	for (const FSWeaponShot& Shot : Shots)
+	{
+		FSWeaponShotResult& Result = Results.AddDefaulted_GetRef();
+		Result.Shot = Shot;
+
+		//Move pawns back to where the client saw them for the duration of the trace (server only)
+		FSLagCompensationScope LagCompensation(GetWorld(), Shot.LagCompensationTimestamp, Shot.TraceStart, Shot.TraceEnd);
 
-		TracerEndPoint = Hit.ImpactPoint;
+		Result.bBlockingHit = GetWorld()->LineTraceSingleByChannel(Result.Hit, Shot.TraceStart, Shot.TraceEnd, COLLISION_WEAPON, GetTraceQueryParams());
 	}
-		
 
-	PlayFireEffects(TracerEndPoint);
+	ResolveShots(Results);
+}
+
+void ASWeapon::ResolveShots(TArrayView<const FSWeaponShotResult> Results)
+{
+	AActor* MyOwner = GetOwner();
+
+	USWeakspotSubsystem* Weakspots = GetWorld()->GetSubsystem<USWeakspotSubsystem>();
+
+	//Damage summed per hit actor, so a batch causes one damage event per victim
+	struct FSBatchDamage
+	{
+		AActor* Victim;
+		float Damage;
+		const FSWeaponShotResult* LastResult;
+	};
+	TArray<FSBatchDamage, TInlineAllocator<8>> BatchDamage;
+
+	FVector MuzzleLocation = MeshComp->GetSocketLocation(MuzzleSocketName);
+
+	// Pellets of the current pattern that hit something
+	uint16 PelletHitMask = 0;
+
+	for (int32 i = 0; i < Results.Num(); i++)
+	{
+		const FSWeaponShotResult& Result = Results[i];
+
+		// Particle "Target" parameter 
+		FVector TracerEndPoint = Result.Shot.TraceEnd;
+
+		EPhysicalSurface SurfaceType = SurfaceType_Default;
+
+		//if blocking collision calculated
+		if (Result.bBlockingHit)
+		{
+			AActor* HitActor = Result.Hit.GetActor();
+
+			// Select the proper impact effect and play it. Weakspots come from the hit body, no complex trace needed
+			SurfaceType = Weakspots ? Weakspots->ResolveSurfaceType(Result.Hit) : UPhysicalMaterial::DetermineSurfaceType(Result.Hit.PhysMaterial.Get());
+
+			//Set Damage Amount
+			float ActualDamage = BaseDamage;
+			if (SurfaceType == SURFACE_FLESHVULNERABLE)
+				ActualDamage *= 4.0f;
+
+			FSBatchDamage* Existing = BatchDamage.FindByPredicate([HitActor](const FSBatchDamage& Entry) { return Entry.Victim == HitActor; });
+			if (Existing)
+			{
+				Existing->Damage += ActualDamage;
+				Existing->LastResult = &Result;
+			}
+			else
+			{
+				BatchDamage.Add({ HitActor, ActualDamage, &Result });
+			}
+
+			PlayImpactEffects(SurfaceType, Result.Hit.ImpactPoint);
+
+			TracerEndPoint = Result.Hit.ImpactPoint;
+		}
+
+
+		//One muzzle flash per pattern
+		PlayFireEffects(TracerEndPoint, Result.Shot.PelletIndex == 0);
+
+
+		//if run by server set hitscan end point
+		if (HasAuthority() && Result.Shot.PelletSeed == 0)
+		{
+			HitScanTrace.AddShot(MuzzleLocation, TracerEndPoint, SurfaceType);
+		}
+		else if (HasAuthority())
+		{
+			if (Result.bBlockingHit)
+				PelletHitMask |= 1 << Result.Shot.PelletIndex;
+
+			//Whole pattern resolved, replicate it as one seed + hit mask
+			bool bLastPellet = i + 1 == Results.Num() || Results[i + 1].Shot.PelletSeed != Result.Shot.PelletSeed;
+			if (bLastPellet)
+			{
+				FPelletPattern Pattern;
+				Pattern.Origin = Result.Shot.TraceStart;
+				Pattern.AimDirection = Result.Shot.ShotDirection;
+				Pattern.Seed = Result.Shot.PelletSeed;
+				Pattern.HitMask = PelletHitMask;
+				Pattern.NumPellets = (uint8)FMath::Min(PelletsPerShot, MAX_PELLETS);
+				PelletTrace.AddPattern(Pattern);
+
+				PelletHitMask = 0;
+			}
+		}
+
+		//For Debuging
+		if (DebugWeaponDrawing > 0)
+			DrawDebugLine(GetWorld(), Result.Shot.TraceStart, Result.Shot.TraceEnd, FColor::White, false, 1.0f, 0, 1.0f);
+	}
 
+	//Apply Damage to hit Actors
+	for (const FSBatchDamage& Entry : BatchDamage)
+	{
+		UGameplayStatics::ApplyPointDamage(Entry.Victim, Entry.Damage, Entry.LastResult->Shot.ShotDirection, Entry.LastResult->Hit,
+			MyOwner ? MyOwner->GetInstigatorController() : nullptr, MyOwner, DamageType);
+	}
 
-	//if run by server set hitscan end point
-	if (HasAuthority())
+	if (Results.Num() > 0)
 	{
-		HitScanTrace.TraceTo = TracerEndPoint;
-		HitScanTrace.SurfaceType = SurfaceType;
+		PlayFireCameraShake();
 	}
+}
 
-	LastFireTime = GetWorld()->TimeSeconds;
+const FCollisionQueryParams& ASWeapon::GetTraceQueryParams()
+{
+	AActor* MyOwner = GetOwner();
+	bool bTraceComplex = USWeakspotSubsystem::UseComplexTraces();
+	if (TraceQueryParamsOwner.Get() != MyOwner || TraceQueryParams.GetIgnoredActors().Num() == 0 || TraceQueryParams.bTraceComplex != bTraceComplex)
+	{
+		//Collision Paramaters
+		TraceQueryParams = FCollisionQueryParams(SCENE_QUERY_STAT(WeaponTrace), bTraceComplex, this);
+		TraceQueryParams.AddIgnoredActor(MyOwner);
+		TraceQueryParams.bReturnPhysicalMaterial = true; //get data on what type of material hit
 
-	//For Debuging
-	if (DebugWeaponDrawing > 0)
-		DrawDebugLine(GetWorld(), EyeLocation, TraceEnd, FColor::White, false, 1.0f, 0, 1.0f);
+		TraceQueryParamsOwner = MyOwner;
+	}
+
+	return TraceQueryParams;
 }
 
 void ASWeapon::StartFire()
 {
 	float Delay = FMath::Max(LastFireTime + TimeBetweenShots - GetWorld()->TimeSeconds, 0.0f);
 
-	GetWorldTimerManager().SetTimer(TimeHandle_TimeBetweenShots, this, &ASWeapon::Fire, TimeBetweenShots, true, Delay);
+	//new seed for every burst, the server replays the same spread from it
+	SpreadStream.Initialize(FMath::Rand());
+	BurstShotCount = 0;
+
+	if (!HasAuthority() && WeaponFireStateMode > 0)
+	{
+		ServerStartFire(SpreadStream.GetInitialSeed(), GetServerWorldTime() + Delay);
+	}
+
+	BeginFiring(Delay);
+}
+
+//First shot after Delay, then one every TimeBetweenShots from the fire accumulator
+void ASWeapon::BeginFiring(float Delay)
+{
+	FireAccumulator = TimeBetweenShots - Delay;
+
+	SetActorTickEnabled(true);
+
+	ConsumeFireAccumulator();
+}
+
+void ASWeapon::EndFiring()
+{
+	SetActorTickEnabled(false);
+
+	FireAccumulator = 0.0f;
+}
+
+void ASWeapon::ServerStartFire_Implementation(int32 SpreadSeed, float StartTimestamp)
+{
+	SpreadStream.Initialize(SpreadSeed);
+	BurstShotCount = 0;
+	BurstStartTimestamp = StartTimestamp;
+	bRemoteBurst = true;
+
+	float Delay = FMath::Max(LastFireTime + TimeBetweenShots - GetWorld()->TimeSeconds, 0.0f);
+
+	BeginFiring(Delay);
 }
 
-void ASWeapon::ServerFire_Implementation()
+bool ASWeapon::ServerStartFire_Validate(int32 SpreadSeed, float StartTimestamp)
 {
+	return true;
+}
+
+void ASWeapon::ServerStopFire_Implementation(int32 ClientShotCount)
+{
+	EndFiring();
+
+	//The client got off more shots than we did before its stop arrived, fire the rest now
+	int32 MissingShots = FMath::Clamp(ClientShotCount - BurstShotCount, 0, MaxCatchUpShots);
+	if (MissingShots > 0)
+	{
+		FireBatch(MissingShots, 0.0f);
+	}
+
+	bRemoteBurst = false;
+	BurstStartTimestamp = -1.0f;
+}
+
+bool ASWeapon::ServerStopFire_Validate(int32 ClientShotCount)
+{
+	return ClientShotCount >= 0;
+}
+
+bool ASWeapon::UseFireStateReplication()
+{
+	return WeaponFireStateMode > 0;
+}
+
+float ASWeapon::GetServerWorldTime() const
+{
+	AGameStateBase* GS = GetWorld()->GetGameState();
+	return GS ? GS->GetServerWorldTimeSeconds() : -1.0f;
+}
+
+void ASWeapon::ServerFire_Implementation(float FireTimestamp)
+{
+	LagCompensationTimestamp = FireTimestamp;
+
 	Fire();
+
+	LagCompensationTimestamp = -1.0f;
 }
 
 //Validate code. If false then disconnect client
-bool ASWeapon::ServerFire_Validate()
+bool ASWeapon::ServerFire_Validate(float FireTimestamp)
 {
 	return true;
 }
@@ -150,25 +611,96 @@ bool ASWeapon::ServerFire_Validate()
 //replicates scan trace
 void ASWeapon::OnRep_HitScanTrace()
 {
-	//Play cosmetic FX
-	PlayFireEffects(HitScanTrace.TraceTo);
+	//Shots fired since the last update we played, at most the ones that were sent
+	uint8 NewShots = HitScanTrace.ShotCounter - LastPlayedShotCounter;
+	int32 NumToPlay = FMath::Min<int32>(NewShots, HitScanTrace.NumShots);
+
+	for (int32 i = HitScanTrace.NumShots - NumToPlay; i < HitScanTrace.NumShots; i++)
+	{
+		const FHitScanShot& Shot = HitScanTrace.GetSentShot(i);
 
-	PlayImpactEffects(HitScanTrace.SurfaceType, HitScanTrace.TraceTo);
+		//Play cosmetic FX
+		PlayFireEffects(Shot.TraceTo);
+
+		PlayImpactEffects(Shot.SurfaceType, Shot.TraceTo);
+	}
+
+	LastPlayedShotCounter = HitScanTrace.ShotCounter;
+}
+
+void ASWeapon::OnRep_PelletTrace()
+{
+	uint8 NewPatterns = PelletTrace.PatternCounter - LastPlayedPatternCounter;
+	int32 NumToPlay = FMath::Min<int32>(NewPatterns, PelletTrace.NumPatterns);
+
+	USWeakspotSubsystem* Weakspots = GetWorld()->GetSubsystem<USWeakspotSubsystem>();
+
+	for (int32 i = PelletTrace.NumPatterns - NumToPlay; i < PelletTrace.NumPatterns; i++)
+	{
+		const FPelletPattern& Pattern = PelletTrace.GetSentPattern(i);
+
+		FRandomStream PelletStream(Pattern.Seed);
+		for (int32 Pellet = 0; Pellet < Pattern.NumPellets; Pellet++)
+		{
+			FVector TraceEnd = Pattern.Origin + (GetPelletDirection(PelletStream, Pattern.AimDirection) * 10000);
+			FVector TracerEndPoint = TraceEnd;
+
+			//Only pellets that hit need a local trace, to find where to put the impact
+			FHitResult Hit;
+			if ((Pattern.HitMask & (1 << Pellet)) && GetWorld()->LineTraceSingleByChannel(Hit, Pattern.Origin, TraceEnd, COLLISION_WEAPON, GetTraceQueryParams()))
+			{
+				EPhysicalSurface SurfaceType = Weakspots ? Weakspots->ResolveSurfaceType(Hit) : UPhysicalMaterial::DetermineSurfaceType(Hit.PhysMaterial.Get());
+				PlayImpactEffects(SurfaceType, Hit.ImpactPoint);
+
+				TracerEndPoint = Hit.ImpactPoint;
+			}
+
+			PlayFireEffects(TracerEndPoint, Pellet == 0);
+		}
+	}
+
+	LastPlayedPatternCounter = PelletTrace.PatternCounter;
+}
+
+void ASWeapon::PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker)
+{
+	Super::PreReplication(ChangedPropertyTracker);
+
+	HitScanTrace.PrepareNetUpdate();
+	PelletTrace.PrepareNetUpdate();
 }
 
 
 void ASWeapon::StopFire()
 {
-	GetWorldTimerManager().ClearTimer(TimeHandle_TimeBetweenShots);
+	EndFiring();
+
+	if (!HasAuthority() && WeaponFireStateMode > 0)
+	{
+		ServerStopFire(BurstShotCount);
+	}
 }
 
 
 
-void ASWeapon::PlayFireEffects(FVector TracerEndPoint)
+void ASWeapon::PlayFireEffects(FVector TracerEndPoint, bool bMuzzleFlash)
 {
-	if (MuzzleEffect)
+	//Nobody to see it
+	if (GetNetMode() == NM_DedicatedServer)
+		return;
+
+	//Pooled, culled FX. Not created on dedicated servers
+	USWeaponFXSubsystem* WeaponFX = GetWorld()->GetSubsystem<USWeaponFXSubsystem>();
+	if (!WeaponFX)
+		return;
+
+	APawn* MyOwner = Cast<APawn>(GetOwner());
+	bool bLocallyControlled = MyOwner && MyOwner->IsLocallyControlled();
+
+	if (MuzzleEffect && bMuzzleFlash)
 	{
-		UGameplayStatics::SpawnEmitterAttached(MuzzleEffect, MeshComp, MuzzleSocketName);
+		//Always show our own muzzle flash
+		WeaponFX->PlayEffectAttached(MuzzleEffect, MeshComp, MuzzleSocketName, bLocallyControlled);
 	}
 
 
@@ -176,16 +708,16 @@ void ASWeapon::PlayFireEffects(FVector TracerEndPoint)
 	{
 		FVector MuzzleLocation = MeshComp->GetSocketLocation(MuzzleSocketName);
 
-		UParticleSystemComponent* TracerComp = UGameplayStatics::SpawnEmitterAtLocation(GetWorld(), TracerEffect, MuzzleLocation);
-
-		if (TracerComp)
-		{
-			TracerComp->SetVectorParameter(TracerTargetName, TracerEndPoint);
-		}
+		WeaponFX->PlayTracerEffect(TracerEffect, MuzzleLocation, TracerEndPoint, TracerTargetName);
 	}
 
+}
+
+void ASWeapon::PlayFireCameraShake()
+{
+	//Only shake our own camera. On the server this would be a reliable RPC per shot
 	APawn* MyOwner = Cast<APawn>(GetOwner());
-	if (MyOwner)
+	if (MyOwner && MyOwner->IsLocallyControlled())
 	{
 		APlayerController* PC = Cast<APlayerController>(MyOwner->GetController());
 		if (PC)
@@ -197,6 +729,13 @@ void ASWeapon::PlayFireEffects(FVector TracerEndPoint)
 
 void ASWeapon::PlayImpactEffects(EPhysicalSurface SurfaceType, FVector ImpactPoint)
 {
+	if (GetNetMode() == NM_DedicatedServer)
+		return;
+
+	USWeaponFXSubsystem* WeaponFX = GetWorld()->GetSubsystem<USWeaponFXSubsystem>();
+	if (!WeaponFX)
+		return;
+
 	UParticleSystem* SelectedEffect = nullptr;
 	switch (SurfaceType)
 	{
@@ -214,8 +753,7 @@ void ASWeapon::PlayImpactEffects(EPhysicalSurface SurfaceType, FVector ImpactPoi
 		FVector ShotDir = ImpactPoint - MuzzleLocation;
 		ShotDir.Normalize();
 
-		UGameplayStatics::SpawnEmitterAtLocation(GetWorld(), SelectedEffect,
-			ImpactPoint, ShotDir.Rotation());
+		WeaponFX->PlayEffectAtLocation(SelectedEffect, ImpactPoint, ShotDir.Rotation());
 	}
 }
 
@@ -227,4 +765,5 @@ void ASWeapon::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetime
 
 
 	DOREPLIFETIME_CONDITION(ASWeapon, HitScanTrace, COND_SkipOwner); //Replicated variable to all machines
+	DOREPLIFETIME_CONDITION(ASWeapon, PelletTrace, COND_SkipOwner);
 }
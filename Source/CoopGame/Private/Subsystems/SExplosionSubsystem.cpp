@@ -0,0 +1,242 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Subsystems/SExplosionSubsystem.h"
+#include "Engine/World.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/DamageType.h"
+#include "Kismet/GameplayStatics.h"
+#include "Components/PrimitiveComponent.h"
+#include "Components/SHealthComponent.h"
+#include "Subsystems/STargetIndexSubsystem.h"
+#include "../../CoopGame.h"
+
+
+DECLARE_CYCLE_STAT(TEXT("Explosion Resolve"), STAT_ExplosionResolve, STATGROUP_CoopGame);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Explosion Resolved"), STAT_ExplosionsResolved, STATGROUP_CoopGame);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Explosion Traces"), STAT_ExplosionTraces, STATGROUP_CoopGame);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Explosion Traces Shared"), STAT_ExplosionTracesShared, STATGROUP_CoopGame);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Explosion Victims Hit"), STAT_ExplosionVictimsHit, STATGROUP_CoopGame);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Explosion Bodies Pushed"), STAT_ExplosionBodiesPushed, STATGROUP_CoopGame);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Explosion Queue Depth"), STAT_ExplosionQueueDepth, STATGROUP_CoopGame);
+
+
+static int32 ExplosionResolverEnabled = 1;
+FAutoConsoleVariableRef CVARExplosionResolverEnabled(
+	TEXT("COOP.ExplosionResolver"),
+	ExplosionResolverEnabled,
+	TEXT("Batch explosion damage at the end of the frame. 0 applies radial damage straight away"),
+	ECVF_Default);
+
+static int32 ExplosionPhysicsImpulses = 1;
+FAutoConsoleVariableRef CVARExplosionPhysicsImpulses(
+	TEXT("COOP.ExplosionPhysicsImpulses"),
+	ExplosionPhysicsImpulses,
+	TEXT("Batched explosions push simulating props in range. 0 only affects pawns"),
+	ECVF_Default);
+
+static int32 ExplosionsPerFrame = 16;
+FAutoConsoleVariableRef CVARExplosionsPerFrame(
+	TEXT("COOP.ExplosionsPerFrame"),
+	ExplosionsPerFrame,
+	TEXT("Most explosions resolved per frame. The rest wait for the next frame"),
+	ECVF_Default);
+
+//Explosions this close together share line of sight traces
+static const float VisibilityCellSize = 50.0f;
+
+//Slack on the target index lookup, targets are found by their center but can be hit at their edge
+static const float VictimSearchSlack = 100.0f;
+
+
+bool USExplosionSubsystem::IsTickable() const
+{
+	return Super::IsTickable() && IsServerWorld();
+}
+
+TStatId USExplosionSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(USExplosionSubsystem, STATGROUP_Tickables);
+}
+
+void USExplosionSubsystem::QueueExplosion(AActor* Causer, AController* Instigator, const FVector& Origin, float BaseDamage, float Radius, TSubclassOf<UDamageType> DamageType, bool bFullDamage)
+{
+	if (!ExplosionResolverEnabled)
+	{
+		TArray<AActor*> IgnoreActors;
+		IgnoreActors.Add(Causer);
+
+		UGameplayStatics::ApplyRadialDamage(GetWorld(), BaseDamage, Origin, Radius, DamageType, IgnoreActors, Causer, Instigator, bFullDamage);
+		return;
+	}
+
+	FSExplosion& Explosion = QueuedExplosions.AddDefaulted_GetRef();
+	Explosion.Causer = Causer;
+	Explosion.Instigator = Instigator;
+	Explosion.Origin = Origin;
+	Explosion.BaseDamage = BaseDamage;
+	Explosion.Radius = Radius;
+	Explosion.DamageType = DamageType;
+	Explosion.bFullDamage = bFullDamage;
+}
+
+//Runs after all actors ticked, so every explosion of this frame is queued
+void USExplosionSubsystem::Tick(float DeltaTime)
+{
+	if (QueuedExplosions.Num() == 0)
+		return;
+
+	SCOPE_CYCLE_COUNTER(STAT_ExplosionResolve);
+
+	//Take this frames batch out first, explosions set off by its damage queue up behind it
+	const int32 NumToResolve = FMath::Min(QueuedExplosions.Num(), FMath::Max(ExplosionsPerFrame, 1));
+	ResolvingExplosions.Reset();
+	ResolvingExplosions.Append(QueuedExplosions.GetData(), NumToResolve);
+	QueuedExplosions.RemoveAt(0, NumToResolve, false);
+
+	INC_DWORD_STAT_BY(STAT_ExplosionsResolved, NumToResolve);
+
+	USTargetIndexSubsystem* TargetIndex = GetWorld()->GetSubsystem<USTargetIndexSubsystem>();
+
+	Victims.Reset();
+	VictimIndices.Reset();
+	VisibilityCache.Reset();
+
+	for (int32 ExplosionIndex = 0; ExplosionIndex < ResolvingExplosions.Num(); ExplosionIndex++)
+	{
+		const FSExplosion& Explosion = ResolvingExplosions[ExplosionIndex];
+		AActor* Causer = Explosion.Causer.Get();
+
+		Candidates.Reset();
+		if (TargetIndex)
+		{
+			TargetIndex->GatherTargetsInRadius(Explosion.Origin, Explosion.Radius + VictimSearchSlack, Candidates);
+		}
+
+		for (APawn* Victim : Candidates)
+		{
+			if (Victim == Causer)
+				continue;
+
+			//Measured to the victims edge, like the overlap radial damage uses
+			const float Distance = FMath::Max(FVector::Dist(Explosion.Origin, Victim->GetActorLocation()) - Victim->GetSimpleCollisionRadius(), 0.0f);
+			if (Distance > Explosion.Radius)
+				continue;
+
+			//Friendly damage would be thrown away by the health component, keep it out of the sum
+			if (USHealthComponent::IsFriendly(Victim, Causer))
+				continue;
+
+			if (!CanDamage(Explosion, Victim))
+				continue;
+
+			const float Damage = Explosion.bFullDamage ? Explosion.BaseDamage : Explosion.BaseDamage * (1.0f - Distance / FMath::Max(Explosion.Radius, 1.0f));
+			if (Damage <= 0.0f)
+				continue;
+
+			int32& VictimIndex = VictimIndices.FindOrAdd(Victim, INDEX_NONE);
+			if (VictimIndex == INDEX_NONE)
+			{
+				VictimIndex = Victims.AddDefaulted();
+				Victims[VictimIndex].Victim = Victim;
+			}
+
+			FSExplosionVictim& Entry = Victims[VictimIndex];
+			Entry.Damage += Damage;
+			if (Damage > Entry.StrongestDamage)
+			{
+				Entry.StrongestDamage = Damage;
+				Entry.StrongestExplosion = ExplosionIndex;
+			}
+		}
+
+		if (ExplosionPhysicsImpulses)
+		{
+			PushPhysicsBodies(Explosion);
+		}
+	}
+
+	//One summed hit per victim, as radial damage so physics and damage handlers treat it like an explosion
+	for (const FSExplosionVictim& Entry : Victims)
+	{
+		AActor* Victim = Entry.Victim.Get();
+		if (!Victim)
+			continue;
+
+		const FSExplosion& Explosion = ResolvingExplosions[Entry.StrongestExplosion];
+
+		FRadialDamageEvent DamageEvent;
+		DamageEvent.DamageTypeClass = Explosion.DamageType ? Explosion.DamageType : TSubclassOf<UDamageType>(UDamageType::StaticClass());
+		DamageEvent.Origin = Explosion.Origin;
+		DamageEvent.Params = FRadialDamageParams(Entry.Damage, 0.0f, Explosion.Radius, Explosion.Radius, 0.0f);
+
+		//Hit point inside the radius, so the summed damage isn't scaled down again
+		FHitResult Hit(Victim, Victim->GetRootComponent() ? Cast<UPrimitiveComponent>(Victim->GetRootComponent()) : nullptr, Explosion.Origin, FVector::UpVector);
+		Hit.ImpactPoint = Explosion.Origin;
+		DamageEvent.ComponentHits.Add(Hit);
+
+		Victim->TakeDamage(Entry.Damage, DamageEvent, Explosion.Instigator.Get(), Explosion.Causer.Get());
+
+		INC_DWORD_STAT(STAT_ExplosionVictimsHit);
+	}
+
+	SET_DWORD_STAT(STAT_ExplosionQueueDepth, QueuedExplosions.Num());
+}
+
+void USExplosionSubsystem::PushPhysicsBodies(const FSExplosion& Explosion)
+{
+	const UDamageType* DamageTypeCDO = Explosion.DamageType ? Explosion.DamageType->GetDefaultObject<UDamageType>() : GetDefault<UDamageType>();
+	if (DamageTypeCDO->DamageImpulse <= 0.0f)
+		return;
+
+	Overlaps.Reset();
+
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(ExplosionPhysicsOverlap), false, Explosion.Causer.Get());
+	GetWorld()->OverlapMultiByObjectType(Overlaps, Explosion.Origin, FQuat::Identity,
+		FCollisionObjectQueryParams(FCollisionObjectQueryParams::InitType::AllDynamicObjects), FCollisionShape::MakeSphere(Explosion.Radius), QueryParams);
+
+	for (const FOverlapResult& Overlap : Overlaps)
+	{
+		UPrimitiveComponent* Component = Overlap.GetComponent();
+		AActor* Owner = Overlap.GetActor();
+		if (!Component || !Owner || !Component->IsSimulatingPhysics() || Cast<APawn>(Owner))
+			continue;
+
+		if (!CanDamage(Explosion, Owner))
+			continue;
+
+		//Same push ReceiveComponentDamage gives for radial damage
+		Component->AddRadialImpulse(Explosion.Origin, Explosion.Radius, DamageTypeCDO->DamageImpulse,
+			Explosion.bFullDamage ? RIF_Constant : RIF_Linear, DamageTypeCDO->bRadialDamageVelChange);
+
+		INC_DWORD_STAT(STAT_ExplosionBodiesPushed);
+	}
+}
+
+bool USExplosionSubsystem::CanDamage(const FSExplosion& Explosion, AActor* Victim)
+{
+	const FIntVector OriginCell(
+		FMath::FloorToInt(Explosion.Origin.X / VisibilityCellSize),
+		FMath::FloorToInt(Explosion.Origin.Y / VisibilityCellSize),
+		FMath::FloorToInt(Explosion.Origin.Z / VisibilityCellSize));
+
+	const TPair<FIntVector, AActor*> Key(OriginCell, Victim);
+
+	const bool* bCached = VisibilityCache.Find(Key);
+	if (bCached)
+	{
+		INC_DWORD_STAT(STAT_ExplosionTracesShared);
+		return *bCached;
+	}
+
+	INC_DWORD_STAT(STAT_ExplosionTraces);
+
+	//Anything blocking visibility between us shields the victim
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(ExplosionVisibility), false, Explosion.Causer.Get());
+	QueryParams.AddIgnoredActor(Victim);
+
+	const bool bVisible = !GetWorld()->LineTraceTestByChannel(Explosion.Origin, Victim->GetActorLocation(), ECC_Visibility, QueryParams);
+
+	VisibilityCache.Add(Key, bVisible);
+	return bVisible;
+}
@@ -0,0 +1,455 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Subsystems/SFlowFieldSubsystem.h"
+#include "Engine/World.h"
+#include "NavigationSystem.h"
+#include "NavigationData.h"
+#include "NavigationPath.h"
+#include "Async/Async.h"
+#include "Async/ParallelFor.h"
+#include "Kismet/GameplayStatics.h"
+#include "../../CoopGame.h"
+
+
+DECLARE_CYCLE_STAT(TEXT("FlowField Build Grid"), STAT_FlowFieldBuildGrid, STATGROUP_CoopGame);
+DECLARE_CYCLE_STAT(TEXT("FlowField Build Field"), STAT_FlowFieldBuildField, STATGROUP_CoopGame);
+DECLARE_DWORD_COUNTER_STAT(TEXT("FlowField Builds Started"), STAT_FlowFieldBuilds, STATGROUP_CoopGame);
+DECLARE_DWORD_COUNTER_STAT(TEXT("FlowField Samples"), STAT_FlowFieldSamples, STATGROUP_CoopGame);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("FlowField Fields"), STAT_FlowFieldFields, STATGROUP_CoopGame);
+
+
+static int32 FlowFieldsEnabled = 1;
+FAutoConsoleVariableRef CVARFlowFieldsEnabled(
+	TEXT("COOP.FlowFields"),
+	FlowFieldsEnabled,
+	TEXT("Tracker bots steer from per target flow fields instead of each requesting paths"),
+	ECVF_Default);
+
+static float FlowFieldCellSize = 100.0f;
+FAutoConsoleVariableRef CVARFlowFieldCellSize(
+	TEXT("COOP.FlowFieldCellSize"),
+	FlowFieldCellSize,
+	TEXT("Size of a flow field cell. Read when the grid is built"),
+	ECVF_Default);
+
+static int32 FlowFieldMaxDistance = 256;
+FAutoConsoleVariableRef CVARFlowFieldMaxDistance(
+	TEXT("COOP.FlowFieldMaxDistance"),
+	FlowFieldMaxDistance,
+	TEXT("Furthest a field reaches from its target, in cells"),
+	ECVF_Default);
+
+static int32 FlowFieldRebuildCells = 2;
+FAutoConsoleVariableRef CVARFlowFieldRebuildCells(
+	TEXT("COOP.FlowFieldRebuildCells"),
+	FlowFieldRebuildCells,
+	TEXT("Rebuild a targets field once it moves this many cells from where the field leads"),
+	ECVF_Default);
+
+//Largest grid built, the cell size grows to fit big levels
+static const int32 FlowGridMaxCells = 1024 * 1024;
+
+//Fields not sampled for this long are dropped
+static const float FlowFieldIdleTime = 5.0f;
+
+//Cells followed ahead when sampling, smooths out the 8 directions
+static const int32 FlowLookahead = 3;
+
+static const uint8 FlowTargetCell = 8;
+static const uint8 FlowUnreachable = 0xFF;
+
+static const FIntPoint FlowNeighbours[8] =
+{
+	FIntPoint(1, 0), FIntPoint(-1, 0), FIntPoint(0, 1), FIntPoint(0, -1),
+	FIntPoint(1, 1), FIntPoint(1, -1), FIntPoint(-1, 1), FIntPoint(-1, -1)
+};
+
+
+bool FSFlowGrid::WorldToCell(const FVector& Location, FIntPoint& OutCell) const
+{
+	OutCell = FIntPoint(FMath::FloorToInt((Location.X - Origin.X) / CellSize), FMath::FloorToInt((Location.Y - Origin.Y) / CellSize));
+	return IsInside(OutCell);
+}
+
+FVector FSFlowGrid::CellToWorld(const FIntPoint& Cell) const
+{
+	return FVector(Origin.X + (Cell.X + 0.5f) * CellSize, Origin.Y + (Cell.Y + 0.5f) * CellSize, Heights[GetIndex(Cell)]);
+}
+
+bool FSFlowGrid::CanStep(int32 FromIndex, int32 ToIndex) const
+{
+	//Up to 45 degree slopes
+	return Walkable[ToIndex] && FMath::Abs(Heights[ToIndex] - Heights[FromIndex]) <= CellSize;
+}
+
+
+bool USFlowFieldSubsystem::IsTickable() const
+{
+	return Super::IsTickable() && IsServerWorld();
+}
+
+TStatId USFlowFieldSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(USFlowFieldSubsystem, STATGROUP_Tickables);
+}
+
+bool USFlowFieldSubsystem::IsEnabled() const
+{
+	return FlowFieldsEnabled > 0;
+}
+
+bool USFlowFieldSubsystem::SampleFlow(AActor* Target, const FVector& Location, FVector& OutMoveTo)
+{
+	if (!Target)
+		return false;
+
+	INC_DWORD_STAT(STAT_FlowFieldSamples);
+
+	FSFlowField* Field = Fields.FindByPredicate([Target](const FSFlowField& Existing) { return Existing.Target == Target; });
+	if (!Field)
+	{
+		//Built next tick
+		Field = &Fields.AddDefaulted_GetRef();
+		Field->Target = Target;
+
+		INC_DWORD_STAT(STAT_FlowFieldFields);
+	}
+
+	Field->LastSampleTime = GetWorld()->TimeSeconds;
+
+	FIntPoint Cell;
+	if (!Field->Current.IsValid() || !Grid->WorldToCell(Location, Cell))
+		return false;
+
+	const FSFlowFieldData& Data = *Field->Current;
+
+	uint8 Direction = Data.Directions[Grid->GetIndex(Cell)];
+	if (Direction == FlowUnreachable)
+		return false;
+
+	if (Direction == FlowTargetCell)
+	{
+		OutMoveTo = Target->GetActorLocation();
+		return true;
+	}
+
+	for (int32 Step = 0; Step < FlowLookahead && Direction < FlowTargetCell; Step++)
+	{
+		Cell += FlowNeighbours[Direction];
+		Direction = Data.Directions[Grid->GetIndex(Cell)];
+	}
+
+	OutMoveTo = Grid->CellToWorld(Cell);
+	return true;
+}
+
+void USFlowFieldSubsystem::Tick(float DeltaTime)
+{
+	if (Fields.Num() == 0 || !EnsureGrid())
+		return;
+
+	const float Now = GetWorld()->TimeSeconds;
+
+	for (int32 i = Fields.Num() - 1; i >= 0; i--)
+	{
+		FSFlowField& Field = Fields[i];
+
+		AActor* Target = Field.Target.Get();
+		if (!Target || Now - Field.LastSampleTime > FlowFieldIdleTime)
+		{
+			//A build still running finishes on its own, nothing waits for it
+			Fields.RemoveAtSwap(i, 1, false);
+
+			DEC_DWORD_STAT(STAT_FlowFieldFields);
+			continue;
+		}
+
+		if (Field.Pending.IsValid() && Field.Pending.IsReady())
+		{
+			Field.Current = Field.Pending.Get();
+			Field.Pending.Reset();
+		}
+
+		if (Field.Pending.IsValid())
+			continue;
+
+		//Rebuild once the target has moved far enough from where the field leads
+		FIntPoint TargetCell;
+		if (!Grid->WorldToCell(Target->GetActorLocation(), TargetCell))
+			continue;
+
+		const FIntPoint Moved = TargetCell - Field.BuildCell;
+		if (Field.Current.IsValid() && FMath::Max(FMath::Abs(Moved.X), FMath::Abs(Moved.Y)) < FlowFieldRebuildCells)
+			continue;
+
+		Field.BuildCell = TargetCell;
+
+		TSharedPtr<FSFlowGrid, ESPMode::ThreadSafe> BuildGridRef = Grid;
+		const int32 MaxDistance = FlowFieldMaxDistance;
+		Field.Pending = Async(EAsyncExecution::ThreadPool, [BuildGridRef, TargetCell, MaxDistance]()
+		{
+			return BuildField(*BuildGridRef, TargetCell, MaxDistance);
+		});
+
+		INC_DWORD_STAT(STAT_FlowFieldBuilds);
+	}
+}
+
+bool USFlowFieldSubsystem::EnsureGrid()
+{
+	if (Grid.IsValid())
+		return true;
+
+	//Navmesh might not be ready yet, don't try every frame
+	if (GetWorld()->TimeSeconds < NextGridAttemptTime)
+		return false;
+
+	NextGridAttemptTime = GetWorld()->TimeSeconds + 5.0f;
+
+	UNavigationSystemV1* NavSys = FNavigationSystem::GetCurrent<UNavigationSystemV1>(GetWorld());
+	const ANavigationData* NavData = NavSys ? NavSys->GetDefaultNavDataInstance(FNavigationSystem::DontCreate) : nullptr;
+	if (!NavData)
+		return false;
+
+	const FBox Bounds = NavData->GetBounds();
+	if (!Bounds.IsValid)
+		return false;
+
+	//Grow cells until the whole navmesh fits the budget
+	float CellSize = FMath::Max(FlowFieldCellSize, 10.0f);
+	const FVector Size = Bounds.GetSize();
+	while ((Size.X / CellSize) * (Size.Y / CellSize) > FlowGridMaxCells)
+	{
+		CellSize *= 2.0f;
+	}
+
+	Grid = BuildGrid(*NavData, Bounds, CellSize);
+
+	UE_LOG(LogTemp, Log, TEXT("Flow field grid: %dx%d cells of %.0f units"), Grid->SizeX, Grid->SizeY, CellSize);
+	return true;
+}
+
+//Projects every cell center onto the navmesh, rows in parallel on worker threads
+TSharedPtr<FSFlowGrid, ESPMode::ThreadSafe> USFlowFieldSubsystem::BuildGrid(const ANavigationData& NavData, const FBox& Bounds, float CellSize)
+{
+	SCOPE_CYCLE_COUNTER(STAT_FlowFieldBuildGrid);
+
+	TSharedPtr<FSFlowGrid, ESPMode::ThreadSafe> NewGrid = MakeShared<FSFlowGrid, ESPMode::ThreadSafe>();
+	NewGrid->Origin = Bounds.Min;
+	NewGrid->CellSize = CellSize;
+	NewGrid->SizeX = FMath::Max(FMath::CeilToInt(Bounds.GetSize().X / CellSize), 1);
+	NewGrid->SizeY = FMath::Max(FMath::CeilToInt(Bounds.GetSize().Y / CellSize), 1);
+	NewGrid->Heights.SetNumZeroed(NewGrid->SizeX * NewGrid->SizeY);
+	NewGrid->Walkable.SetNumZeroed(NewGrid->SizeX * NewGrid->SizeY);
+
+	const FVector Extent(CellSize * 0.5f, CellSize * 0.5f, Bounds.GetExtent().Z);
+	const float CenterZ = Bounds.GetCenter().Z;
+	FSharedConstNavQueryFilter Filter = NavData.GetDefaultQueryFilter();
+
+	FSFlowGrid& GridRef = *NewGrid;
+	ParallelFor(GridRef.SizeY, [&GridRef, &NavData, &Extent, CenterZ, &Filter](int32 Y)
+	{
+		for (int32 X = 0; X < GridRef.SizeX; X++)
+		{
+			const FIntPoint Cell(X, Y);
+			FVector Center = GridRef.CellToWorld(Cell);
+			Center.Z = CenterZ;
+
+			FNavLocation Projected;
+			if (NavData.ProjectPoint(Center, Projected, Extent, Filter))
+			{
+				const int32 Index = GridRef.GetIndex(Cell);
+				GridRef.Walkable[Index] = true;
+				GridRef.Heights[Index] = Projected.Location.Z;
+			}
+		}
+	});
+
+	return NewGrid;
+}
+
+//Breadth first out from the target, then every cell points at its closest neighbour
+FSFlowFieldDataPtr USFlowFieldSubsystem::BuildField(const FSFlowGrid& Grid, const FIntPoint& TargetCell, int32 MaxDistance)
+{
+	SCOPE_CYCLE_COUNTER(STAT_FlowFieldBuildField);
+
+	const int32 NumCells = Grid.SizeX * Grid.SizeY;
+
+	TSharedPtr<FSFlowFieldData, ESPMode::ThreadSafe> Field = MakeShared<FSFlowFieldData, ESPMode::ThreadSafe>();
+	Field->TargetCell = TargetCell;
+	Field->Directions.Init(FlowUnreachable, NumCells);
+
+	if (!Grid.IsInside(TargetCell))
+		return Field;
+
+	TArray<uint16> Distances;
+	Distances.Init(MAX_uint16, NumCells);
+
+	TArray<int32> Open;
+	Open.Reserve(FMath::Min(NumCells, 64 * 1024));
+
+	const int32 TargetIndex = Grid.GetIndex(TargetCell);
+	Distances[TargetIndex] = 0;
+	Open.Add(TargetIndex);
+
+	//Diagonals only when both sides are open, no cutting corners
+	auto CanMove = [&Grid](const FIntPoint& From, int32 Direction)
+	{
+		const FIntPoint To = From + FlowNeighbours[Direction];
+		if (!Grid.IsInside(To) || !Grid.CanStep(Grid.GetIndex(From), Grid.GetIndex(To)))
+			return false;
+
+		if (Direction >= 4)
+		{
+			const FIntPoint SideX(To.X, From.Y);
+			const FIntPoint SideY(From.X, To.Y);
+			return Grid.CanStep(Grid.GetIndex(From), Grid.GetIndex(SideX)) && Grid.CanStep(Grid.GetIndex(From), Grid.GetIndex(SideY));
+		}
+		return true;
+	};
+
+	for (int32 Head = 0; Head < Open.Num(); Head++)
+	{
+		const int32 Index = Open[Head];
+		const uint16 Distance = Distances[Index];
+		if (Distance >= MaxDistance)
+			continue;
+
+		const FIntPoint Cell(Index % Grid.SizeX, Index / Grid.SizeX);
+		for (int32 Direction = 0; Direction < 8; Direction++)
+		{
+			if (!CanMove(Cell, Direction))
+				continue;
+
+			const int32 NeighbourIndex = Grid.GetIndex(Cell + FlowNeighbours[Direction]);
+			if (Distances[NeighbourIndex] == MAX_uint16)
+			{
+				Distances[NeighbourIndex] = Distance + 1;
+				Open.Add(NeighbourIndex);
+			}
+		}
+	}
+
+	//Every reached cell steps to its neighbour closest to the target. Movement is symmetric, so the reverse step is valid
+	for (int32 Index : Open)
+	{
+		if (Index == TargetIndex)
+		{
+			Field->Directions[Index] = FlowTargetCell;
+			continue;
+		}
+
+		const FIntPoint Cell(Index % Grid.SizeX, Index / Grid.SizeX);
+		uint16 BestDistance = Distances[Index];
+
+		for (int32 Direction = 0; Direction < 8; Direction++)
+		{
+			const FIntPoint Neighbour = Cell + FlowNeighbours[Direction];
+			if (!Grid.IsInside(Neighbour))
+				continue;
+
+			const uint16 NeighbourDistance = Distances[Grid.GetIndex(Neighbour)];
+			if (NeighbourDistance < BestDistance && CanMove(Cell, Direction))
+			{
+				BestDistance = NeighbourDistance;
+				Field->Directions[Index] = (uint8)Direction;
+			}
+		}
+	}
+
+	return Field;
+}
+
+
+//Compares per bot path queries against one flow field shared by every bot, at several bot counts
+static void BenchmarkBotNavigation(const TArray<FString>& Args, UWorld* World)
+{
+	USFlowFieldSubsystem* FlowFields = World ? World->GetSubsystem<USFlowFieldSubsystem>() : nullptr;
+	UNavigationSystemV1* NavSys = World ? FNavigationSystem::GetCurrent<UNavigationSystemV1>(World) : nullptr;
+	APawn* Goal = World ? UGameplayStatics::GetPlayerPawn(World, 0) : nullptr;
+	if (!FlowFields || !NavSys || !Goal)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("COOP.BenchmarkBotNavigation: needs a navmesh and a player pawn"));
+		return;
+	}
+
+	double StartTime = FPlatformTime::Seconds();
+	if (!FlowFields->EnsureGrid())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("COOP.BenchmarkBotNavigation: no navmesh to build the grid from"));
+		return;
+	}
+	UE_LOG(LogTemp, Log, TEXT("COOP.BenchmarkBotNavigation: grid ready in %.2f ms (built once per level)"), (FPlatformTime::Seconds() - StartTime) * 1000.0);
+
+	TArray<int32> BotCounts;
+	for (const FString& Arg : Args)
+	{
+		BotCounts.Add(FMath::Max(FCString::Atoi(*Arg), 1));
+	}
+	if (BotCounts.Num() == 0)
+	{
+		BotCounts = { 50, 200, 1000 };
+	}
+
+	const FSFlowGrid& Grid = *FlowFields->GetGrid();
+	const FVector GoalLocation = Goal->GetActorLocation();
+
+	FIntPoint GoalCell;
+	if (!Grid.WorldToCell(GoalLocation, GoalCell))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("COOP.BenchmarkBotNavigation: player is outside the flow field grid"));
+		return;
+	}
+
+	for (int32 NumBots : BotCounts)
+	{
+		TArray<FVector> Starts;
+		Starts.Reserve(NumBots);
+		for (int32 i = 0; i < NumBots; i++)
+		{
+			FNavLocation Start;
+			if (NavSys->GetRandomReachablePointInRadius(GoalLocation, 5000.0f, Start))
+			{
+				Starts.Add(Start.Location);
+			}
+		}
+
+		if (Starts.Num() == 0)
+			continue;
+
+		//What every bot used to do
+		StartTime = FPlatformTime::Seconds();
+		int32 NumPaths = 0;
+		for (const FVector& Start : Starts)
+		{
+			UNavigationPath* Path = UNavigationSystemV1::FindPathToLocationSynchronously(World, Start, GoalLocation);
+			NumPaths += (Path && Path->IsValid()) ? 1 : 0;
+		}
+		const double PathTime = FPlatformTime::Seconds() - StartTime;
+
+		//One field, then a lookup per bot
+		StartTime = FPlatformTime::Seconds();
+		FSFlowFieldDataPtr Field = USFlowFieldSubsystem::BuildField(Grid, GoalCell, FlowFieldMaxDistance);
+		const double BuildTime = FPlatformTime::Seconds() - StartTime;
+
+		int32 NumCovered = 0;
+		StartTime = FPlatformTime::Seconds();
+		for (const FVector& Start : Starts)
+		{
+			FIntPoint Cell;
+			NumCovered += (Grid.WorldToCell(Start, Cell) && Field->Directions[Grid.GetIndex(Cell)] != FlowUnreachable) ? 1 : 0;
+		}
+		const double SampleTime = FPlatformTime::Seconds() - StartTime;
+
+		UE_LOG(LogTemp, Log, TEXT("  %d bots: path queries %.2f us/bot (%d found) | flow field %.2f us/bot (build %.2f ms, %.3f us/sample, %d covered)"),
+			Starts.Num(),
+			PathTime * 1000000.0 / Starts.Num(), NumPaths,
+			(BuildTime + SampleTime) * 1000000.0 / Starts.Num(), BuildTime * 1000.0, SampleTime * 1000000.0 / Starts.Num(), NumCovered);
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs BenchmarkBotNavigationCmd(
+	TEXT("COOP.BenchmarkBotNavigation"),
+	TEXT("Time per bot path queries against a shared flow field. Optional args: bot counts, default 50 200 1000"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&BenchmarkBotNavigation));
@@ -0,0 +1,248 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Subsystems/SGameplayTimerSubsystem.h"
+#include "../../CoopGame.h"
+
+
+DECLARE_CYCLE_STAT(TEXT("Gameplay Timers"), STAT_GameplayTimers, STATGROUP_CoopGame);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Gameplay Timers Fired"), STAT_GameplayTimersFired, STATGROUP_CoopGame);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Gameplay Timers Bot Path"), STAT_GameplayTimersBotPath, STATGROUP_CoopGame);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Gameplay Timers Bot Self Damage"), STAT_GameplayTimersBotSelfDamage, STATGROUP_CoopGame);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Gameplay Timers Bot Pool"), STAT_GameplayTimersBotPool, STATGROUP_CoopGame);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Gameplay Timers Powerup"), STAT_GameplayTimersPowerup, STATGROUP_CoopGame);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Gameplay Timers Pickup Respawn"), STAT_GameplayTimersPickupRespawn, STATGROUP_CoopGame);
+
+
+//Length of one wheel tick. Timers fire on the first frame at or after the tick they are due
+static const float TimerWheelResolution = 1.0f / 60.0f;
+
+//Power of two. Timers further out than one turn of the wheel sit in their bucket until their turn comes round
+static const int32 NumTimerBuckets = 512;
+
+
+void USGameplayTimerSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	Buckets.Init(INDEX_NONE, NumTimerBuckets);
+	FirstFree = INDEX_NONE;
+	FMemory::Memzero(ActiveCounts);
+	Now = 0.0f;
+	LastTick = 0;
+}
+
+void USGameplayTimerSubsystem::Deinitialize()
+{
+	Timers.Empty();
+	Buckets.Empty();
+	Firing.Empty();
+	FirstFree = INDEX_NONE;
+	FMemory::Memzero(ActiveCounts);
+
+	Super::Deinitialize();
+}
+
+TStatId USGameplayTimerSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(USGameplayTimerSubsystem, STATGROUP_Tickables);
+}
+
+void USGameplayTimerSubsystem::SetTimerInternal(FSGameplayTimerHandle& Handle, UObject* Target, FSGameplayTimerCallback Callback, float Delay, bool bLoop, ESGameplayTimerCategory Category, float FirstDelay)
+{
+	ClearTimer(Handle);
+
+	//Same as the timer manager, no delay means no timer
+	const float FirstWait = FirstDelay >= 0.0f ? FirstDelay : Delay;
+	if (!Target || !Callback || FirstWait < 0.0f || (FirstDelay < 0.0f && Delay <= 0.0f))
+		return;
+
+	int32 Index = FirstFree;
+	if (Index != INDEX_NONE)
+	{
+		FirstFree = Timers[Index].Next;
+	}
+	else
+	{
+		Index = Timers.AddDefaulted();
+	}
+
+	FSGameplayTimer& Timer = Timers[Index];
+	Timer.Target = Target;
+	Timer.Callback = Callback;
+	Timer.Interval = Delay;
+	Timer.DueTime = Now + FirstWait;
+	Timer.Category = Category;
+	Timer.bLoop = bLoop && Delay > 0.0f;
+	Timer.bActive = true;
+
+	Schedule(Index);
+
+	ActiveCounts[(uint8)Category]++;
+
+	Handle.Index = Index;
+	Handle.Serial = Timer.Serial;
+}
+
+void USGameplayTimerSubsystem::ClearTimer(FSGameplayTimerHandle& Handle)
+{
+	const int32 Index = FindTimer(Handle);
+	if (Index != INDEX_NONE)
+	{
+		FreeTimer(Index);
+	}
+
+	Handle.Invalidate();
+}
+
+bool USGameplayTimerSubsystem::IsTimerActive(const FSGameplayTimerHandle& Handle) const
+{
+	return FindTimer(Handle) != INDEX_NONE;
+}
+
+int32 USGameplayTimerSubsystem::FindTimer(const FSGameplayTimerHandle& Handle) const
+{
+	if (!Timers.IsValidIndex(Handle.Index))
+		return INDEX_NONE;
+
+	const FSGameplayTimer& Timer = Timers[Handle.Index];
+	return (Timer.bActive && Timer.Serial == Handle.Serial) ? Handle.Index : INDEX_NONE;
+}
+
+void USGameplayTimerSubsystem::Schedule(int32 Index)
+{
+	FSGameplayTimer& Timer = Timers[Index];
+
+	//Never into a tick that has already been walked
+	Timer.DueTick = FMath::Max(LastTick + 1, (int64)FMath::CeilToDouble(Timer.DueTime / TimerWheelResolution));
+	Timer.Bucket = (int32)(Timer.DueTick & (NumTimerBuckets - 1));
+
+	Timer.Prev = INDEX_NONE;
+	Timer.Next = Buckets[Timer.Bucket];
+	if (Timer.Next != INDEX_NONE)
+	{
+		Timers[Timer.Next].Prev = Index;
+	}
+	Buckets[Timer.Bucket] = Index;
+}
+
+void USGameplayTimerSubsystem::Unlink(int32 Index)
+{
+	FSGameplayTimer& Timer = Timers[Index];
+	if (Timer.Bucket == INDEX_NONE)
+		return;
+
+	if (Timer.Prev != INDEX_NONE)
+	{
+		Timers[Timer.Prev].Next = Timer.Next;
+	}
+	else
+	{
+		Buckets[Timer.Bucket] = Timer.Next;
+	}
+
+	if (Timer.Next != INDEX_NONE)
+	{
+		Timers[Timer.Next].Prev = Timer.Prev;
+	}
+
+	Timer.Bucket = INDEX_NONE;
+	Timer.Prev = INDEX_NONE;
+	Timer.Next = INDEX_NONE;
+}
+
+void USGameplayTimerSubsystem::FreeTimer(int32 Index)
+{
+	Unlink(Index);
+
+	FSGameplayTimer& Timer = Timers[Index];
+	ActiveCounts[(uint8)Timer.Category]--;
+
+	Timer.bActive = false;
+	Timer.Serial++;
+	Timer.Target = nullptr;
+	Timer.Callback = nullptr;
+
+	Timer.Next = FirstFree;
+	FirstFree = Index;
+}
+
+void USGameplayTimerSubsystem::Tick(float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_GameplayTimers);
+
+	Now += DeltaTime;
+
+	const int64 CurrentTick = (int64)FMath::FloorToDouble(Now / TimerWheelResolution);
+	if (CurrentTick > LastTick)
+	{
+		//Long frames walk every bucket once at most
+		const int64 NumSteps = FMath::Min(CurrentTick - LastTick, (int64)NumTimerBuckets);
+
+		//Take every due timer out first, callbacks are free to set and clear timers while the batch fires
+		Firing.Reset();
+		for (int64 Step = 1; Step <= NumSteps; Step++)
+		{
+			int32 Index = Buckets[(int32)((LastTick + Step) & (NumTimerBuckets - 1))];
+			while (Index != INDEX_NONE)
+			{
+				const int32 Next = Timers[Index].Next;
+				if (Timers[Index].DueTick <= CurrentTick)
+				{
+					Unlink(Index);
+					Firing.Add(TPair<int32, uint32>(Index, Timers[Index].Serial));
+				}
+				Index = Next;
+			}
+		}
+
+		LastTick = CurrentTick;
+
+		for (const TPair<int32, uint32>& Entry : Firing)
+		{
+			const int32 Index = Entry.Key;
+
+			//Cleared by an earlier callback in this batch
+			if (!Timers[Index].bActive || Timers[Index].Serial != Entry.Value)
+				continue;
+
+			FSGameplayTimer& Timer = Timers[Index];
+			UObject* Target = Timer.Target.Get();
+			const FSGameplayTimerCallback Callback = Timer.Callback;
+
+			if (!Target)
+			{
+				FreeTimer(Index);
+				continue;
+			}
+
+			//Rescheduled or freed before the call, like the timer manager. Timers may grow during the callback
+			if (Timer.bLoop)
+			{
+				Timer.DueTime += Timer.Interval;
+
+				//Fell behind after a hitch, pick up the rhythm from now instead of firing every tick to catch up
+				if (Timer.DueTime <= Now)
+				{
+					Timer.DueTime = Now + Timer.Interval;
+				}
+
+				Schedule(Index);
+			}
+			else
+			{
+				FreeTimer(Index);
+			}
+
+			INC_DWORD_STAT(STAT_GameplayTimersFired);
+
+			Callback(Target);
+		}
+	}
+
+	SET_DWORD_STAT(STAT_GameplayTimersBotPath, ActiveCounts[(uint8)ESGameplayTimerCategory::BotPath]);
+	SET_DWORD_STAT(STAT_GameplayTimersBotSelfDamage, ActiveCounts[(uint8)ESGameplayTimerCategory::BotSelfDamage]);
+	SET_DWORD_STAT(STAT_GameplayTimersBotPool, ActiveCounts[(uint8)ESGameplayTimerCategory::BotPool]);
+	SET_DWORD_STAT(STAT_GameplayTimersPowerup, ActiveCounts[(uint8)ESGameplayTimerCategory::Powerup]);
+	SET_DWORD_STAT(STAT_GameplayTimersPickupRespawn, ActiveCounts[(uint8)ESGameplayTimerCategory::PickupRespawn]);
+}
@@ -0,0 +1,283 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Subsystems/SLagCompensationSubsystem.h"
+#include "Engine/World.h"
+#include "GameFramework/Pawn.h"
+#include "Components/PrimitiveComponent.h"
+#include "Components/SkeletalMeshComponent.h"
+#include "PhysicsEngine/BodyInstance.h"
+#include "DrawDebugHelpers.h"
+#include "../../CoopGame.h"
+
+
+DECLARE_CYCLE_STAT(TEXT("LagComp Record"), STAT_LagCompRecord, STATGROUP_CoopGame);
+DECLARE_CYCLE_STAT(TEXT("LagComp Rewind"), STAT_LagCompRewind, STATGROUP_CoopGame);
+DECLARE_DWORD_COUNTER_STAT(TEXT("LagComp Shots Rewound"), STAT_LagCompShots, STATGROUP_CoopGame);
+DECLARE_DWORD_COUNTER_STAT(TEXT("LagComp Pawns Rewound"), STAT_LagCompPawns, STATGROUP_CoopGame);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("LagComp Tracked Pawns"), STAT_LagCompTrackedPawns, STATGROUP_CoopGame);
+DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT("LagComp Avg Rewind Cost (ms)"), STAT_LagCompAvgCost, STATGROUP_CoopGame);
+
+
+static int32 LagCompensationEnabled = 1;
+FAutoConsoleVariableRef CVARLagCompensationEnabled(
+	TEXT("COOP.LagCompensation"),
+	LagCompensationEnabled,
+	TEXT("Rewind pawns to the client fire time when the server processes a shot"),
+	ECVF_Default);
+
+static float LagCompensationMaxRewind = 0.3f;
+FAutoConsoleVariableRef CVARLagCompensationMaxRewind(
+	TEXT("COOP.LagCompensationMaxRewind"),
+	LagCompensationMaxRewind,
+	TEXT("Furthest back in time (seconds) the server will rewind a shot"),
+	ECVF_Default);
+
+static int32 DebugLagCompensationDrawing = 0;
+FAutoConsoleVariableRef CVARDebugLagCompensationDrawing(
+	TEXT("COOP.DebugLagCompensation"),
+	DebugLagCompensationDrawing,
+	TEXT("Draw rewound hitboxes"),
+	ECVF_Cheat);
+
+
+void FSLagCompensationHistory::Record(const FTransform& Transform, float Time)
+{
+	Head = (Head + 1) % LAGCOMPENSATION_HISTORY_SIZE;
+	NumSamples = FMath::Min(NumSamples + 1, LAGCOMPENSATION_HISTORY_SIZE);
+
+	FSLagCompensationSample& Sample = Samples[Head];
+	Sample.Rotation = Transform.GetRotation();
+	Sample.Location = Transform.GetLocation();
+	Sample.Time = Time;
+}
+
+bool FSLagCompensationHistory::GetTransformAtTime(float Time, FTransform& OutTransform) const
+{
+	if (NumSamples == 0 || Time >= Samples[Head].Time)
+		return false;
+
+	//walk back from the newest sample until we pass Time
+	const FSLagCompensationSample* Newer = &Samples[Head];
+	for (int32 Step = 1; Step < NumSamples; Step++)
+	{
+		const FSLagCompensationSample& Older = Samples[(Head - Step + LAGCOMPENSATION_HISTORY_SIZE) % LAGCOMPENSATION_HISTORY_SIZE];
+		if (Older.Time <= Time)
+		{
+			const float Alpha = (Time - Older.Time) / FMath::Max(Newer->Time - Older.Time, KINDA_SMALL_NUMBER);
+			OutTransform.SetRotation(FQuat::Slerp(Older.Rotation, Newer->Rotation, Alpha));
+			OutTransform.SetLocation(FMath::Lerp(Older.Location, Newer->Location, Alpha));
+			return true;
+		}
+		Newer = &Older;
+	}
+
+	//Older than anything recorded, use the oldest sample
+	OutTransform.SetRotation(Newer->Rotation);
+	OutTransform.SetLocation(Newer->Location);
+	return true;
+}
+
+
+void USLagCompensationSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	Histories.Reserve(64);
+	RewoundBodies.Reserve(64);
+}
+
+bool USLagCompensationSubsystem::IsTickable() const
+{
+	return Super::IsTickable() && IsServerWorld() && Histories.Num() > 0;
+}
+
+TStatId USLagCompensationSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(USLagCompensationSubsystem, STATGROUP_Tickables);
+}
+
+bool USLagCompensationSubsystem::IsEnabled() const
+{
+	return LagCompensationEnabled > 0 && IsServerWorld();
+}
+
+//Record where every hitbox ended up this frame
+void USLagCompensationSubsystem::Tick(float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_LagCompRecord);
+
+	const float Now = GetWorld()->GetTimeSeconds();
+
+	for (int32 i = Histories.Num() - 1; i >= 0; i--)
+	{
+		FSLagCompensationHistory& History = Histories[i];
+
+		UPrimitiveComponent* HitBox = History.HitBox.Get();
+		if (!HitBox)
+		{
+			Histories.RemoveAtSwap(i, 1, false);
+			continue;
+		}
+
+		History.Record(HitBox->GetComponentTransform(), Now);
+	}
+
+	SET_DWORD_STAT(STAT_LagCompTrackedPawns, Histories.Num());
+	SET_FLOAT_STAT(STAT_LagCompAvgCost, AverageRewindCostMs);
+}
+
+void USLagCompensationSubsystem::RegisterPawn(APawn* Pawn)
+{
+	if (!Pawn || FindHistoryIndex(Pawn) != INDEX_NONE)
+		return;
+
+	UPrimitiveComponent* HitBox = FindHitBox(Pawn);
+	if (!HitBox)
+		return;
+
+	FSLagCompensationHistory& History = Histories.AddZeroed_GetRef();
+	History.Pawn = Pawn;
+	History.HitBox = HitBox;
+	History.Head = LAGCOMPENSATION_HISTORY_SIZE - 1;
+
+	//Bounds can be offset from the component origin (skeletal meshes are rooted at the feet)
+	const FBoxSphereBounds& Bounds = HitBox->Bounds;
+	History.ReachRadius = (Bounds.Origin - HitBox->GetComponentLocation()).Size() + Bounds.SphereRadius;
+}
+
+void USLagCompensationSubsystem::UnregisterPawn(APawn* Pawn)
+{
+	if (!Pawn)
+		return;
+
+	int32 Index = FindHistoryIndex(Pawn);
+	if (Index != INDEX_NONE)
+	{
+		Histories.RemoveAtSwap(Index, 1, false);
+	}
+}
+
+int32 USLagCompensationSubsystem::FindHistoryIndex(const APawn* Pawn) const
+{
+	return Histories.IndexOfByPredicate([Pawn](const FSLagCompensationHistory& History)
+	{
+		return History.Pawn.Get() == Pawn;
+	});
+}
+
+//first component that blocks weapon traces
+UPrimitiveComponent* USLagCompensationSubsystem::FindHitBox(APawn* Pawn)
+{
+	TInlineComponentArray<UPrimitiveComponent*> Primitives(Pawn);
+	for (UPrimitiveComponent* Primitive : Primitives)
+	{
+		if (Primitive->IsCollisionEnabled() && Primitive->GetCollisionResponseToChannel(COLLISION_WEAPON) == ECR_Block)
+		{
+			return Primitive;
+		}
+	}
+
+	return nullptr;
+}
+
+void USLagCompensationSubsystem::Rewind(float Timestamp, const FVector& TraceStart, const FVector& TraceEnd)
+{
+	SCOPE_CYCLE_COUNTER(STAT_LagCompRewind);
+	INC_DWORD_STAT(STAT_LagCompShots);
+
+	ensure(RewoundBodies.Num() == 0);
+
+	RewindStartTime = FPlatformTime::Seconds();
+
+	const float Now = GetWorld()->GetTimeSeconds();
+	Timestamp = FMath::Clamp(Timestamp, Now - LagCompensationMaxRewind, Now);
+
+	for (const FSLagCompensationHistory& History : Histories)
+	{
+		UPrimitiveComponent* HitBox = History.HitBox.Get();
+		FTransform RewoundTransform;
+		if (!HitBox || !HitBox->IsCollisionEnabled() || !History.GetTransformAtTime(Timestamp, RewoundTransform))
+			continue;
+
+		//Skip pawns the shot could not have reached
+		if (FMath::PointDistToSegmentSquared(RewoundTransform.GetLocation(), TraceStart, TraceEnd) > FMath::Square(History.ReachRadius))
+			continue;
+
+		INC_DWORD_STAT(STAT_LagCompPawns);
+
+		//Only move the physics bodies, traces hit those. The component and its overlaps stay untouched
+		const FTransform& CurrentTransform = HitBox->GetComponentTransform();
+		RewoundTransform.SetScale3D(CurrentTransform.GetScale3D());
+		const FTransform Delta = CurrentTransform.Inverse() * RewoundTransform;
+
+		auto RewindBody = [this, &Delta](FBodyInstance* Body)
+		{
+			if (Body && Body->IsValidBodyInstance())
+			{
+				const FTransform OriginalTransform = Body->GetUnrealWorldTransform();
+				RewoundBodies.Add({ Body, OriginalTransform });
+				Body->SetBodyTransform(OriginalTransform * Delta, ETeleportType::TeleportPhysics, false);
+			}
+		};
+
+		if (USkeletalMeshComponent* SkelComp = Cast<USkeletalMeshComponent>(HitBox))
+		{
+			for (FBodyInstance* Body : SkelComp->Bodies)
+			{
+				RewindBody(Body);
+			}
+		}
+		else
+		{
+			RewindBody(HitBox->GetBodyInstance());
+		}
+
+		if (DebugLagCompensationDrawing)
+		{
+			DrawDebugSphere(GetWorld(), RewoundTransform.GetLocation(), History.ReachRadius, 12, FColor::Cyan, false, 1.0f, 0, 1.0f);
+		}
+	}
+}
+
+void USLagCompensationSubsystem::Restore()
+{
+	SCOPE_CYCLE_COUNTER(STAT_LagCompRewind);
+
+	for (const FSRewoundBody& Rewound : RewoundBodies)
+	{
+		Rewound.Body->SetBodyTransform(Rewound.OriginalTransform, ETeleportType::TeleportPhysics, false);
+	}
+
+	//keeps the allocation for the next shot
+	RewoundBodies.Reset();
+
+	const float CostMs = (FPlatformTime::Seconds() - RewindStartTime) * 1000.0;
+	AverageRewindCostMs = FMath::Lerp(AverageRewindCostMs, CostMs, 0.05f);
+}
+
+
+FSLagCompensationScope::FSLagCompensationScope(UWorld* World, float Timestamp, const FVector& TraceStart, const FVector& TraceEnd)
+	: LagCompensation(nullptr)
+{
+	if (Timestamp < 0.0f || !World)
+		return;
+
+	LagCompensation = World->GetSubsystem<USLagCompensationSubsystem>();
+	if (LagCompensation && LagCompensation->IsEnabled())
+	{
+		LagCompensation->Rewind(Timestamp, TraceStart, TraceEnd);
+	}
+	else
+	{
+		LagCompensation = nullptr;
+	}
+}
+
+FSLagCompensationScope::~FSLagCompensationScope()
+{
+	if (LagCompensation)
+	{
+		LagCompensation->Restore();
+	}
+}
@@ -0,0 +1,201 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Subsystems/SPathRequestSubsystem.h"
+#include "Engine/World.h"
+#include "NavigationSystem.h"
+#include "NavigationData.h"
+#include "NavAgentInterface.h"
+#include "../../CoopGame.h"
+
+
+DECLARE_CYCLE_STAT(TEXT("PathRequest Flush"), STAT_PathRequestFlush, STATGROUP_CoopGame);
+DECLARE_DWORD_COUNTER_STAT(TEXT("PathRequest Queries Sent"), STAT_PathQueriesSent, STATGROUP_CoopGame);
+DECLARE_DWORD_COUNTER_STAT(TEXT("PathRequest Requests Merged"), STAT_PathRequestsMerged, STATGROUP_CoopGame);
+DECLARE_DWORD_COUNTER_STAT(TEXT("PathRequest Merge Raycasts"), STAT_PathRequestMergeRaycasts, STATGROUP_CoopGame);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("PathRequest Queue Depth"), STAT_PathQueueDepth, STATGROUP_CoopGame);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("PathRequest In Flight"), STAT_PathQueriesInFlight, STATGROUP_CoopGame);
+DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT("PathRequest Avg Latency (ms)"), STAT_PathQueryLatency, STATGROUP_CoopGame);
+
+
+static int32 PathQueriesPerFrame = 8;
+FAutoConsoleVariableRef CVARPathQueriesPerFrame(
+	TEXT("COOP.PathQueriesPerFrame"),
+	PathQueriesPerFrame,
+	TEXT("Most async path queries started per frame. Requests over budget wait for the next frame"),
+	ECVF_Default);
+
+static float PathRequestMergeRadius = 300.0f;
+FAutoConsoleVariableRef CVARPathRequestMergeRadius(
+	TEXT("COOP.PathRequestMergeRadius"),
+	PathRequestMergeRadius,
+	TEXT("Requests to the same goal starting this close to each other, with nothing on the navmesh between them, share a path query. 0 only merges requests from the same nav poly"),
+	ECVF_Default);
+
+
+bool USPathRequestSubsystem::IsTickable() const
+{
+	return Super::IsTickable() && IsServerWorld();
+}
+
+TStatId USPathRequestSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(USPathRequestSubsystem, STATGROUP_Tickables);
+}
+
+void USPathRequestSubsystem::RequestPath(AActor* Requester, const FVector& Start, AActor* Goal, const FSPathFoundDelegate& Callback)
+{
+	if (!Requester || !Goal)
+		return;
+
+	FSPathRequest* Request = QueuedRequests.FindByPredicate([Requester](const FSPathRequest& Queued) { return Queued.Requester == Requester; });
+	if (!Request)
+	{
+		Request = &QueuedRequests.AddDefaulted_GetRef();
+		Request->QueueTime = FPlatformTime::Seconds();
+	}
+
+	Request->Requester = Requester;
+	Request->Goal = Goal;
+	Request->Start = Start;
+	Request->StartPoly = INVALID_NAVNODEREF;
+	Request->Callback = Callback;
+}
+
+//Runs after all actors ticked, so every request of this frame is queued
+void USPathRequestSubsystem::Tick(float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_PathRequestFlush);
+
+	SET_FLOAT_STAT(STAT_PathQueryLatency, AverageLatencyMs);
+
+	if (QueuedRequests.Num() == 0)
+		return;
+
+	UNavigationSystemV1* NavSys = FNavigationSystem::GetCurrent<UNavigationSystemV1>(GetWorld());
+	if (!NavSys)
+		return;
+
+	//Start poly of each request, requests in the same poly can share a path
+	for (FSPathRequest& Request : QueuedRequests)
+	{
+		FNavLocation StartLocation;
+		if (Request.StartPoly == INVALID_NAVNODEREF && NavSys->ProjectPointToNavigation(Request.Start, StartLocation))
+		{
+			Request.StartPoly = StartLocation.NodeRef;
+		}
+	}
+
+	int32 NumQueries = 0;
+	while (QueuedRequests.Num() > 0 && NumQueries < FMath::Max(PathQueriesPerFrame, 1))
+	{
+		FSPathRequest Leader = QueuedRequests[0];
+		QueuedRequests.RemoveAt(0, 1, false);
+
+		AActor* Requester = Leader.Requester.Get();
+		AActor* Goal = Leader.Goal.Get();
+		if (!Requester)
+			continue;
+
+		//Goal went away, say so or the requester keeps waiting on us
+		if (!Goal)
+		{
+			Leader.Callback.ExecuteIfBound(false, TArray<FNavPathPoint>());
+			continue;
+		}
+
+		const INavAgentInterface* NavAgent = Cast<INavAgentInterface>(Requester);
+		const FNavAgentProperties& AgentProps = NavAgent ? NavAgent->GetNavAgentPropertiesRef() : FNavAgentProperties::DefaultProperties;
+
+		const ANavigationData* NavData = NavSys->GetNavDataForProps(AgentProps);
+		if (!NavData)
+		{
+			Leader.Callback.ExecuteIfBound(false, TArray<FNavPathPoint>());
+			continue;
+		}
+
+		FSPathQuery Query;
+		Query.IssueTime = FPlatformTime::Seconds();
+
+		//Everyone else going to the same goal from the same area rides along
+		for (int32 i = QueuedRequests.Num() - 1; i >= 0; i--)
+		{
+			const FSPathRequest& Other = QueuedRequests[i];
+			if (Other.Goal != Leader.Goal)
+				continue;
+
+			bool bSamePoly = Other.StartPoly != INVALID_NAVNODEREF && Other.StartPoly == Leader.StartPoly;
+
+			//Close by isn't enough, a wall or a floor can be in between. Only share when the navmesh goes straight across
+			bool bConnected = bSamePoly;
+			if (!bConnected && FVector::DistSquared(Other.Start, Leader.Start) <= FMath::Square(PathRequestMergeRadius))
+			{
+				FVector HitLocation;
+				bConnected = !NavData->Raycast(Leader.Start, Other.Start, HitLocation, NavData->GetDefaultQueryFilter(), Requester);
+
+				INC_DWORD_STAT(STAT_PathRequestMergeRaycasts);
+			}
+
+			if (bConnected)
+			{
+				Query.Requests.Add(Other);
+				QueuedRequests.RemoveAtSwap(i, 1, false);
+
+				INC_DWORD_STAT(STAT_PathRequestsMerged);
+			}
+		}
+
+		FPathFindingQuery PathQuery(Requester, *NavData, Leader.Start, Goal->GetActorLocation(), NavData->GetDefaultQueryFilter());
+
+		Query.Requests.Add(MoveTemp(Leader));
+
+		uint32 QueryId = NavSys->FindPathAsync(AgentProps, PathQuery,
+			FNavPathQueryDelegate::CreateUObject(this, &USPathRequestSubsystem::OnQueryFinished), EPathFindingMode::Regular);
+
+		if (QueryId == INVALID_NAVQUERYID)
+		{
+			for (FSPathRequest& Request : Query.Requests)
+			{
+				Request.Callback.ExecuteIfBound(false, TArray<FNavPathPoint>());
+			}
+			continue;
+		}
+
+		InFlightQueries.Add(QueryId, MoveTemp(Query));
+		NumQueries++;
+
+		INC_DWORD_STAT(STAT_PathQueriesSent);
+		INC_DWORD_STAT(STAT_PathQueriesInFlight);
+	}
+
+	SET_DWORD_STAT(STAT_PathQueueDepth, QueuedRequests.Num());
+}
+
+void USPathRequestSubsystem::OnQueryFinished(uint32 QueryId, ENavigationQueryResult::Type Result, FNavPathSharedPtr Path)
+{
+	FSPathQuery Query;
+	if (!InFlightQueries.RemoveAndCopyValue(QueryId, Query))
+		return;
+
+	DEC_DWORD_STAT(STAT_PathQueriesInFlight);
+
+	const float LatencyMs = (FPlatformTime::Seconds() - Query.IssueTime) * 1000.0;
+	AverageLatencyMs = FMath::Lerp(AverageLatencyMs, LatencyMs, 0.05f);
+
+	const bool bSuccess = Result == ENavigationQueryResult::Success && Path.IsValid() && Path->GetPathPoints().Num() > 0;
+
+	for (FSPathRequest& Request : Query.Requests)
+	{
+		ResultPoints.Reset();
+
+		if (bSuccess)
+		{
+			ResultPoints.Append(Path->GetPathPoints());
+
+			//Merged requesters start from where they are, not where the leader was
+			ResultPoints[0].Location = Request.Start;
+		}
+
+		Request.Callback.ExecuteIfBound(bSuccess, ResultPoints);
+	}
+}
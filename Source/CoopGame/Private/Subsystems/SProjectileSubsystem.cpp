@@ -0,0 +1,349 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Subsystems/SProjectileSubsystem.h"
+#include "Subsystems/SWeaponFXSubsystem.h"
+#include "Subsystems/SExplosionSubsystem.h"
+#include "Engine/World.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/MovementComponent.h"
+#include "Kismet/GameplayStatics.h"
+#include "SProjectileWeapon.h"
+#include "../../CoopGame.h"
+
+
+DECLARE_CYCLE_STAT(TEXT("Projectile Simulate"), STAT_ProjectileSimulate, STATGROUP_CoopGame);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Projectile Sweeps"), STAT_ProjectileSweeps, STATGROUP_CoopGame);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Projectile Live"), STAT_ProjectilesLive, STATGROUP_CoopGame);
+DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT("Projectile Sim Cost (ms)"), STAT_ProjectileSimCost, STATGROUP_CoopGame);
+
+
+static int32 ProjectileSimulation = 0;
+FAutoConsoleVariableRef CVARProjectileSimulation(
+	TEXT("COOP.ProjectileSimulation"),
+	ProjectileSimulation,
+	TEXT("Simulate weapon projectiles as data in the projectile subsystem. Needs weapons set up with a visual class and flight params. 0 spawns an actor per projectile"),
+	ECVF_Default);
+
+static int32 ProjectileBudget = 256;
+FAutoConsoleVariableRef CVARProjectileBudget(
+	TEXT("COOP.ProjectileBudget"),
+	ProjectileBudget,
+	TEXT("Projectiles reserved up front. More can be live, but will allocate"),
+	ECVF_Default);
+
+static float ProjectileCorrectionRate = 10.0f;
+FAutoConsoleVariableRef CVARProjectileCorrectionRate(
+	TEXT("COOP.ProjectileCorrectionRate"),
+	ProjectileCorrectionRate,
+	TEXT("How fast a predicted projectile visual blends onto the server path after reconciling. Higher is faster"),
+	ECVF_Default);
+
+//Slower than this after a bounce and the projectile comes to rest
+static const float ProjectileRestSpeed = 20.0f;
+
+
+void USProjectileSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	Positions.Reserve(ProjectileBudget);
+	Velocities.Reserve(ProjectileBudget);
+	Lifetimes.Reserve(ProjectileBudget);
+	TypeIds.Reserve(ProjectileBudget);
+	Cosmetic.Reserve(ProjectileBudget);
+	Owners.Reserve(ProjectileBudget);
+	DamageCausers.Reserve(ProjectileBudget);
+	DamageInstigators.Reserve(ProjectileBudget);
+	PredictionIds.Reserve(ProjectileBudget);
+	VisualOffsets.Reserve(ProjectileBudget);
+	Visuals.Reserve(ProjectileBudget);
+
+	bShowVisuals = !IsRunningDedicatedServer();
+}
+
+void USProjectileSubsystem::Deinitialize()
+{
+	for (TPair<UClass*, FSProjectileVisualPool>& Pair : VisualPools)
+	{
+		for (AActor* Visual : Pair.Value.Actors)
+		{
+			if (Visual)
+			{
+				Visual->Destroy();
+			}
+		}
+	}
+	VisualPools.Empty();
+
+	Super::Deinitialize();
+}
+
+TStatId USProjectileSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(USProjectileSubsystem, STATGROUP_Tickables);
+}
+
+bool USProjectileSubsystem::IsEnabled() const
+{
+	return ProjectileSimulation > 0;
+}
+
+int32 USProjectileSubsystem::FindOrAddType(ASProjectileWeapon* Weapon)
+{
+	int32* ExistingIndex = TypeIndices.Find(Weapon->GetClass());
+	if (ExistingIndex)
+		return *ExistingIndex;
+
+	FSProjectileType& Type = Types.AddDefaulted_GetRef();
+	Type.Params = Weapon->GetProjectileParams();
+	Type.Damage = Weapon->GetProjectileDamage();
+	Type.DamageType = Weapon->GetDamageType();
+	Type.VisualClass = Weapon->GetProjectileVisualClass();
+
+	return TypeIndices.Add(Weapon->GetClass(), Types.Num() - 1);
+}
+
+void USProjectileSubsystem::LaunchProjectile(ASProjectileWeapon* Weapon, const FVector& Location, const FVector& Velocity, bool bCosmetic, float FastForward, int32 PredictionId)
+{
+	if (!Weapon)
+		return;
+
+	//Nothing to see or do for a cosmetic projectile
+	if (bCosmetic && !bShowVisuals)
+		return;
+
+	const int32 TypeId = FindOrAddType(Weapon);
+	const FSProjectileType& Type = Types[TypeId];
+
+	Positions.Add(Location);
+	Velocities.Add(Velocity);
+	Lifetimes.Add(Type.Params.Lifetime);
+	TypeIds.Add((uint16)TypeId);
+	Cosmetic.Add(bCosmetic);
+	Owners.Add(Weapon);
+
+	AActor* MyOwner = Weapon->GetOwner();
+	DamageCausers.Add(MyOwner);
+	DamageInstigators.Add(MyOwner ? MyOwner->GetInstigatorController() : nullptr);
+	PredictionIds.Add(PredictionId);
+	VisualOffsets.Add(FVector::ZeroVector);
+	Visuals.Add(bShowVisuals ? AcquireVisual(Type.VisualClass, Location, Velocity.Rotation()) : nullptr);
+
+	INC_DWORD_STAT(STAT_ProjectilesLive);
+
+	if (FastForward > 0.0f && !SimulateProjectile(Positions.Num() - 1, FastForward))
+	{
+		RemoveProjectile(Positions.Num() - 1);
+	}
+}
+
+bool USProjectileSubsystem::ReconcileProjectile(ASProjectileWeapon* Weapon, int32 PredictionId, const FVector& Location, const FVector& Velocity, float FastForward)
+{
+	int32 Index = INDEX_NONE;
+	for (int32 i = 0; i < PredictionIds.Num(); i++)
+	{
+		if (PredictionIds[i] == PredictionId && Owners[i] == Weapon)
+		{
+			Index = i;
+			break;
+		}
+	}
+
+	if (Index == INDEX_NONE)
+		return false;
+
+	//Replay the server projectile from its launch, keeping the visual where it is for now
+	const FVector PredictedVisual = Positions[Index] + VisualOffsets[Index];
+
+	Positions[Index] = Location;
+	Velocities[Index] = Velocity;
+	Lifetimes[Index] = Types[TypeIds[Index]].Params.Lifetime;
+	PredictionIds[Index] = INDEX_NONE;
+	VisualOffsets[Index] = FVector::ZeroVector;
+
+	if (!SimulateProjectile(Index, FastForward))
+	{
+		RemoveProjectile(Index);
+		return true;
+	}
+
+	VisualOffsets[Index] = PredictedVisual - Positions[Index];
+	return true;
+}
+
+void USProjectileSubsystem::Tick(float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_ProjectileSimulate);
+
+	const double StartTime = FPlatformTime::Seconds();
+
+	//Backwards so removing swaps in a projectile that was already stepped
+	for (int32 i = Positions.Num() - 1; i >= 0; i--)
+	{
+		if (!SimulateProjectile(i, DeltaTime))
+		{
+			RemoveProjectile(i);
+		}
+	}
+
+	LastSimulationMs = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+	SET_FLOAT_STAT(STAT_ProjectileSimCost, LastSimulationMs);
+}
+
+bool USProjectileSubsystem::SimulateProjectile(int32 Index, float DeltaTime)
+{
+	const FSProjectileType& Type = Types[TypeIds[Index]];
+
+	Lifetimes[Index] -= DeltaTime;
+
+	FVector& Position = Positions[Index];
+	FVector& Velocity = Velocities[Index];
+
+	Velocity.Z += GetWorld()->GetGravityZ() * Type.Params.GravityScale * DeltaTime;
+
+	const FVector Start = Position;
+	const FVector End = Start + Velocity * DeltaTime;
+
+	if (!Start.Equals(End))
+	{
+		FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(ProjectileSweep), false, Owners[Index].Get());
+		QueryParams.AddIgnoredActor(DamageCausers[Index].Get());
+
+		INC_DWORD_STAT(STAT_ProjectileSweeps);
+
+		FHitResult Hit;
+		if (GetWorld()->SweepSingleByChannel(Hit, Start, End, FQuat::Identity, COLLISION_WEAPON, FCollisionShape::MakeSphere(Type.Params.CollisionRadius), QueryParams))
+		{
+			if (Type.Params.bExplodeOnPawnImpact && Cast<APawn>(Hit.GetActor()))
+			{
+				Explode(Index, Hit.Location);
+				return false;
+			}
+
+			//Bounce off the surface, losing the speed going into it
+			Position = Hit.Location + Hit.ImpactNormal * 0.1f;
+			Velocity = Velocity - (1.0f + Type.Params.Bounciness) * (Velocity | Hit.ImpactNormal) * Hit.ImpactNormal;
+
+			if (Velocity.SizeSquared() < FMath::Square(ProjectileRestSpeed))
+			{
+				Velocity = FVector::ZeroVector;
+			}
+		}
+		else
+		{
+			Position = End;
+		}
+	}
+
+	if (Lifetimes[Index] <= 0.0f)
+	{
+		Explode(Index, Position);
+		return false;
+	}
+
+	AActor* Visual = Visuals[Index];
+	if (Visual)
+	{
+		FVector& VisualOffset = VisualOffsets[Index];
+		VisualOffset *= FMath::Exp(-ProjectileCorrectionRate * DeltaTime);
+
+		Visual->SetActorLocationAndRotation(Position + VisualOffset, Velocity.IsNearlyZero() ? Visual->GetActorRotation() : Velocity.Rotation());
+	}
+
+	return true;
+}
+
+void USProjectileSubsystem::Explode(int32 Index, const FVector& Location)
+{
+	const FSProjectileType& Type = Types[TypeIds[Index]];
+
+	if (!Cosmetic[Index])
+	{
+		//The pawn is the causer like for hitscan damage, weapons have no team so their damage would count as friendly
+		USExplosionSubsystem* Explosions = GetWorld()->GetSubsystem<USExplosionSubsystem>();
+		AActor* DamageCauser = DamageCausers[Index].Get();
+		if (Explosions && DamageCauser)
+		{
+			Explosions->QueueExplosion(DamageCauser, DamageInstigators[Index].Get(), Location, Type.Damage, Type.Params.ExplosionRadius, Type.DamageType, true);
+		}
+	}
+
+	USWeaponFXSubsystem* WeaponFX = GetWorld()->GetSubsystem<USWeaponFXSubsystem>();
+	if (WeaponFX)
+	{
+		WeaponFX->PlayEffectAtLocation(Type.Params.ExplosionEffect, Location);
+	}
+}
+
+void USProjectileSubsystem::RemoveProjectile(int32 Index)
+{
+	if (Visuals[Index])
+	{
+		ReleaseVisual(Visuals[Index]);
+	}
+
+	Positions.RemoveAtSwap(Index, 1, false);
+	Velocities.RemoveAtSwap(Index, 1, false);
+	Lifetimes.RemoveAtSwap(Index, 1, false);
+	TypeIds.RemoveAtSwap(Index, 1, false);
+	Cosmetic.RemoveAtSwap(Index, 1, false);
+	Owners.RemoveAtSwap(Index, 1, false);
+	DamageCausers.RemoveAtSwap(Index, 1, false);
+	DamageInstigators.RemoveAtSwap(Index, 1, false);
+	PredictionIds.RemoveAtSwap(Index, 1, false);
+	VisualOffsets.RemoveAtSwap(Index, 1, false);
+	Visuals.RemoveAtSwap(Index, 1, false);
+
+	DEC_DWORD_STAT(STAT_ProjectilesLive);
+}
+
+AActor* USProjectileSubsystem::AcquireVisual(TSubclassOf<AActor> VisualClass, const FVector& Location, const FRotator& Rotation)
+{
+	if (!VisualClass)
+		return nullptr;
+
+	FSProjectileVisualPool& Pool = VisualPools.FindOrAdd(VisualClass);
+
+	while (Pool.Actors.Num() > 0)
+	{
+		AActor* Visual = Pool.Actors.Pop(false);
+
+		//Could have been destroyed with the level streamed out under it
+		if (IsValid(Visual))
+		{
+			Visual->SetActorLocationAndRotation(Location, Rotation);
+			Visual->SetActorHiddenInGame(false);
+			return Visual;
+		}
+	}
+
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	SpawnParams.bDeferConstruction = true;
+
+	AActor* Visual = GetWorld()->SpawnActor<AActor>(VisualClass, Location, Rotation, SpawnParams);
+	if (!Visual)
+		return nullptr;
+
+	//Local only, we move it ourselves
+	Visual->SetReplicates(false);
+	Visual->FinishSpawning(FTransform(Rotation, Location));
+
+	Visual->SetActorEnableCollision(false);
+
+	TInlineComponentArray<UMovementComponent*> MovementComponents(Visual);
+	for (UMovementComponent* MovementComp : MovementComponents)
+	{
+		MovementComp->Deactivate();
+	}
+
+	return Visual;
+}
+
+void USProjectileSubsystem::ReleaseVisual(AActor* Visual)
+{
+	Visual->SetActorHiddenInGame(true);
+
+	VisualPools.FindOrAdd(Visual->GetClass()).Actors.Add(Visual);
+}
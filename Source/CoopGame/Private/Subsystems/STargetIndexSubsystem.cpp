@@ -0,0 +1,356 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Subsystems/STargetIndexSubsystem.h"
+#include "Engine/World.h"
+#include "GameFramework/Pawn.h"
+#include "../../CoopGame.h"
+
+
+DECLARE_CYCLE_STAT(TEXT("TargetIndex Update"), STAT_TargetIndexUpdate, STATGROUP_CoopGame);
+DECLARE_CYCLE_STAT(TEXT("TargetIndex Query"), STAT_TargetIndexQuery, STATGROUP_CoopGame);
+DECLARE_DWORD_COUNTER_STAT(TEXT("TargetIndex Queries"), STAT_TargetIndexQueries, STATGROUP_CoopGame);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("TargetIndex Targets"), STAT_TargetIndexTargets, STATGROUP_CoopGame);
+
+
+static float TargetIndexCellSize = 2000.0f;
+FAutoConsoleVariableRef CVARTargetIndexCellSize(
+	TEXT("COOP.TargetIndexCellSize"),
+	TargetIndexCellSize,
+	TEXT("Size of a target index grid cell. Only read when a target moves cells, change it before the level starts"),
+	ECVF_Default);
+
+//Teams this small are checked in one pass instead of through the grid
+static const int32 LinearScanMaxTargets = 64;
+
+
+int32 FSTargetTeam::Find(const APawn* Pawn) const
+{
+	for (int32 i = 0; i < Pawns.Num(); i++)
+	{
+		if (Pawns[i].Get() == Pawn)
+			return i;
+	}
+	return INDEX_NONE;
+}
+
+void FSTargetTeam::Add(APawn* Pawn, const FVector& Location, const FIntPoint& Cell)
+{
+	const int32 Index = Pawns.Add(Pawn);
+	X.Add(Location.X);
+	Y.Add(Location.Y);
+	Z.Add(Location.Z);
+	CellOf.Add(Cell);
+
+	Cells.FindOrAdd(Cell).Add(Index);
+}
+
+void FSTargetTeam::RemoveAt(int32 Index)
+{
+	TArray<int32>* Cell = Cells.Find(CellOf[Index]);
+	if (Cell)
+	{
+		Cell->RemoveSingleSwap(Index, false);
+		if (Cell->Num() == 0)
+		{
+			Cells.Remove(CellOf[Index]);
+		}
+	}
+
+	//The last target is swapped into Index, point its cell at the new slot
+	const int32 LastIndex = Pawns.Num() - 1;
+	if (Index != LastIndex)
+	{
+		TArray<int32>& LastCell = Cells.FindChecked(CellOf[LastIndex]);
+		LastCell[LastCell.IndexOfByKey(LastIndex)] = Index;
+	}
+
+	Pawns.RemoveAtSwap(Index, 1, false);
+	X.RemoveAtSwap(Index, 1, false);
+	Y.RemoveAtSwap(Index, 1, false);
+	Z.RemoveAtSwap(Index, 1, false);
+	CellOf.RemoveAtSwap(Index, 1, false);
+}
+
+void FSTargetTeam::MoveToCell(int32 Index, const FIntPoint& NewCell)
+{
+	TArray<int32>& OldCell = Cells.FindChecked(CellOf[Index]);
+	OldCell.RemoveSingleSwap(Index, false);
+	if (OldCell.Num() == 0)
+	{
+		Cells.Remove(CellOf[Index]);
+	}
+
+	Cells.FindOrAdd(NewCell).Add(Index);
+	CellOf[Index] = NewCell;
+}
+
+
+bool USTargetIndexSubsystem::IsTickable() const
+{
+	return Super::IsTickable() && IsServerWorld();
+}
+
+TStatId USTargetIndexSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(USTargetIndexSubsystem, STATGROUP_Tickables);
+}
+
+FIntPoint USTargetIndexSubsystem::GetCell(const FVector& Location) const
+{
+	const float CellSize = FMath::Max(TargetIndexCellSize, 100.0f);
+	return FIntPoint(FMath::FloorToInt(Location.X / CellSize), FMath::FloorToInt(Location.Y / CellSize));
+}
+
+void USTargetIndexSubsystem::RegisterTarget(APawn* Pawn, uint8 TeamNum)
+{
+	if (!Pawn)
+		return;
+
+	FSTargetTeam& Team = Teams.FindOrAdd(TeamNum);
+	if (Team.Find(Pawn) != INDEX_NONE)
+		return;
+
+	const FVector Location = Pawn->GetActorLocation();
+	Team.Add(Pawn, Location, GetCell(Location));
+
+	INC_DWORD_STAT(STAT_TargetIndexTargets);
+}
+
+void USTargetIndexSubsystem::UnregisterTarget(APawn* Pawn)
+{
+	if (!Pawn)
+		return;
+
+	for (TPair<uint8, FSTargetTeam>& Pair : Teams)
+	{
+		int32 Index = Pair.Value.Find(Pawn);
+		if (Index != INDEX_NONE)
+		{
+			Pair.Value.RemoveAt(Index);
+
+			DEC_DWORD_STAT(STAT_TargetIndexTargets);
+			return;
+		}
+	}
+}
+
+int32 USTargetIndexSubsystem::GetNumTargets() const
+{
+	int32 NumTargets = 0;
+	for (const TPair<uint8, FSTargetTeam>& Pair : Teams)
+	{
+		NumTargets += Pair.Value.Num();
+	}
+	return NumTargets;
+}
+
+//Refresh positions, targets only change cells when they cross a cell edge
+void USTargetIndexSubsystem::Tick(float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_TargetIndexUpdate);
+
+	for (TPair<uint8, FSTargetTeam>& Pair : Teams)
+	{
+		FSTargetTeam& Team = Pair.Value;
+
+		for (int32 i = Team.Num() - 1; i >= 0; i--)
+		{
+			APawn* Pawn = Team.Pawns[i].Get();
+			if (!Pawn)
+			{
+				Team.RemoveAt(i);
+
+				DEC_DWORD_STAT(STAT_TargetIndexTargets);
+				continue;
+			}
+
+			const FVector Location = Pawn->GetActorLocation();
+			Team.X[i] = Location.X;
+			Team.Y[i] = Location.Y;
+			Team.Z[i] = Location.Z;
+
+			const FIntPoint Cell = GetCell(Location);
+			if (Cell != Team.CellOf[i])
+			{
+				Team.MoveToCell(i, Cell);
+			}
+		}
+	}
+}
+
+APawn* USTargetIndexSubsystem::FindNearestTarget(const FVector& Location, uint8 TeamNum) const
+{
+	SCOPE_CYCLE_COUNTER(STAT_TargetIndexQuery);
+	INC_DWORD_STAT(STAT_TargetIndexQueries);
+
+	APawn* BestTarget = nullptr;
+	float BestDistSquared = FLT_MAX;
+
+	for (const TPair<uint8, FSTargetTeam>& Pair : Teams)
+	{
+		//Same team is friendly
+		if (Pair.Key == TeamNum || Pair.Value.Num() == 0)
+			continue;
+
+		float DistSquared = FLT_MAX;
+		int32 Index = Pair.Value.Num() <= LinearScanMaxTargets
+			? FindNearestLinear(Pair.Value, Location, DistSquared)
+			: FindNearestInGrid(Pair.Value, Location, DistSquared);
+
+		if (Index != INDEX_NONE && DistSquared < BestDistSquared)
+		{
+			BestTarget = Pair.Value.Pawns[Index].Get();
+			BestDistSquared = DistSquared;
+		}
+	}
+
+	return BestTarget;
+}
+
+int32 USTargetIndexSubsystem::FindNearestLinear(const FSTargetTeam& Team, const FVector& Location, float& OutDistSquared) const
+{
+	int32 BestIndex = INDEX_NONE;
+	OutDistSquared = FLT_MAX;
+
+	const int32 Num = Team.Num();
+	int32 i = 0;
+
+	//4 targets at a time
+	const VectorRegister QueryX = VectorSetFloat1(Location.X);
+	const VectorRegister QueryY = VectorSetFloat1(Location.Y);
+	const VectorRegister QueryZ = VectorSetFloat1(Location.Z);
+
+	for (; i + 4 <= Num; i += 4)
+	{
+		VectorRegister DX = VectorSubtract(VectorLoad(&Team.X[i]), QueryX);
+		VectorRegister DY = VectorSubtract(VectorLoad(&Team.Y[i]), QueryY);
+		VectorRegister DZ = VectorSubtract(VectorLoad(&Team.Z[i]), QueryZ);
+
+		VectorRegister DistSquared = VectorMultiplyAdd(DZ, DZ, VectorMultiplyAdd(DY, DY, VectorMultiply(DX, DX)));
+
+		float Distances[4];
+		VectorStore(DistSquared, Distances);
+
+		for (int32 Lane = 0; Lane < 4; Lane++)
+		{
+			if (Distances[Lane] < OutDistSquared)
+			{
+				OutDistSquared = Distances[Lane];
+				BestIndex = i + Lane;
+			}
+		}
+	}
+
+	for (; i < Num; i++)
+	{
+		float DistSquared = FVector::DistSquared(FVector(Team.X[i], Team.Y[i], Team.Z[i]), Location);
+		if (DistSquared < OutDistSquared)
+		{
+			OutDistSquared = DistSquared;
+			BestIndex = i;
+		}
+	}
+
+	return BestIndex;
+}
+
+int32 USTargetIndexSubsystem::FindNearestInGrid(const FSTargetTeam& Team, const FVector& Location, float& OutDistSquared) const
+{
+	int32 BestIndex = INDEX_NONE;
+	OutDistSquared = FLT_MAX;
+
+	const float CellSize = FMath::Max(TargetIndexCellSize, 100.0f);
+	const FIntPoint Center = GetCell(Location);
+
+	int32 NumChecked = 0;
+
+	for (int32 Ring = 0; NumChecked < Team.Num(); Ring++)
+	{
+		//Anything in this ring or further is at least this far away
+		if (BestIndex != INDEX_NONE && FMath::Square((Ring - 1) * CellSize) > OutDistSquared)
+			break;
+
+		for (int32 CellX = Center.X - Ring; CellX <= Center.X + Ring; CellX++)
+		{
+			//Only the edge of the ring, the inside was checked already
+			const bool bEdgeColumn = (CellX == Center.X - Ring || CellX == Center.X + Ring);
+			const int32 StepY = bEdgeColumn ? 1 : FMath::Max(Ring * 2, 1);
+
+			for (int32 CellY = Center.Y - Ring; CellY <= Center.Y + Ring; CellY += StepY)
+			{
+				const TArray<int32>* Cell = Team.Cells.Find(FIntPoint(CellX, CellY));
+				if (!Cell)
+					continue;
+
+				for (int32 Index : *Cell)
+				{
+					float DistSquared = FVector::DistSquared(FVector(Team.X[Index], Team.Y[Index], Team.Z[Index]), Location);
+					if (DistSquared < OutDistSquared)
+					{
+						OutDistSquared = DistSquared;
+						BestIndex = Index;
+					}
+				}
+
+				NumChecked += Cell->Num();
+			}
+		}
+	}
+
+	return BestIndex;
+}
+
+void USTargetIndexSubsystem::GatherTargetsInRadius(const FVector& Location, float Radius, TArray<APawn*>& OutTargets) const
+{
+	SCOPE_CYCLE_COUNTER(STAT_TargetIndexQuery);
+	INC_DWORD_STAT(STAT_TargetIndexQueries);
+
+	const float RadiusSquared = Radius * Radius;
+
+	auto GatherIfInRange = [&OutTargets, &Location, RadiusSquared](const FSTargetTeam& Team, int32 Index)
+	{
+		if (FVector::DistSquared(FVector(Team.X[Index], Team.Y[Index], Team.Z[Index]), Location) <= RadiusSquared)
+		{
+			APawn* Pawn = Team.Pawns[Index].Get();
+			if (Pawn)
+			{
+				OutTargets.Add(Pawn);
+			}
+		}
+	};
+
+	const FIntPoint MinCell = GetCell(Location - FVector(Radius));
+	const FIntPoint MaxCell = GetCell(Location + FVector(Radius));
+	const int32 NumCells = (MaxCell.X - MinCell.X + 1) * (MaxCell.Y - MinCell.Y + 1);
+
+	for (const TPair<uint8, FSTargetTeam>& Pair : Teams)
+	{
+		const FSTargetTeam& Team = Pair.Value;
+
+		//Small teams, or a radius covering more cells than there are targets, are cheaper to walk whole
+		if (Team.Num() <= LinearScanMaxTargets || NumCells > Team.Num())
+		{
+			for (int32 i = 0; i < Team.Num(); i++)
+			{
+				GatherIfInRange(Team, i);
+			}
+			continue;
+		}
+
+		for (int32 CellX = MinCell.X; CellX <= MaxCell.X; CellX++)
+		{
+			for (int32 CellY = MinCell.Y; CellY <= MaxCell.Y; CellY++)
+			{
+				const TArray<int32>* Cell = Team.Cells.Find(FIntPoint(CellX, CellY));
+				if (!Cell)
+					continue;
+
+				for (int32 Index : *Cell)
+				{
+					GatherIfInRange(Team, Index);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,48 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Subsystems/STickableWorldSubsystem.h"
+#include "Engine/World.h"
+
+
+bool USTickableWorldSubsystem::ShouldCreateSubsystem(UObject* Outer) const
+{
+	UWorld* World = Cast<UWorld>(Outer);
+	return World && World->IsGameWorld();
+}
+
+void USTickableWorldSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	bInitialized = true;
+}
+
+void USTickableWorldSubsystem::Deinitialize()
+{
+	bInitialized = false;
+
+	Super::Deinitialize();
+}
+
+ETickableTickType USTickableWorldSubsystem::GetTickableTickType() const
+{
+	//The CDO registers as a tickable too, never tick it
+	return HasAnyFlags(RF_ClassDefaultObject) ? ETickableTickType::Never : ETickableTickType::Conditional;
+}
+
+bool USTickableWorldSubsystem::IsTickable() const
+{
+	return bInitialized && GetWorld() != nullptr;
+}
+
+UWorld* USTickableWorldSubsystem::GetTickableGameObjectWorld() const
+{
+	return GetWorld();
+}
+
+bool USTickableWorldSubsystem::IsServerWorld() const
+{
+	UWorld* World = GetWorld();
+	return World && World->GetNetMode() != NM_Client;
+}
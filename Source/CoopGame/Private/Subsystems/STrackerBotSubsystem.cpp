@@ -0,0 +1,770 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Subsystems/STrackerBotSubsystem.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+#include "Components/StaticMeshComponent.h"
+#include "Physics/PhysicsInterfaceCore.h"
+#include "Async/ParallelFor.h"
+#include "AI/STrackerBot.h"
+#include "Subsystems/STargetIndexSubsystem.h"
+#include "../../CoopGame.h"
+
+
+DECLARE_CYCLE_STAT(TEXT("TrackerBot Steering"), STAT_TrackerBotSteering, STATGROUP_CoopGame);
+DECLARE_CYCLE_STAT(TEXT("TrackerBot Steering Apply"), STAT_TrackerBotSteeringApply, STATGROUP_CoopGame);
+DECLARE_CYCLE_STAT(TEXT("TrackerBot Significance"), STAT_TrackerBotSignificance, STATGROUP_CoopGame);
+DECLARE_CYCLE_STAT(TEXT("TrackerBot Kinematic Move"), STAT_TrackerBotKinematicMove, STATGROUP_CoopGame);
+DECLARE_CYCLE_STAT(TEXT("TrackerBot Separation Grid"), STAT_TrackerBotSeparationGrid, STATGROUP_CoopGame);
+DECLARE_CYCLE_STAT(TEXT("TrackerBot Proximity"), STAT_TrackerBotProximity, STATGROUP_CoopGame);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("TrackerBot Steered Bots"), STAT_TrackerBotSteeredBots, STATGROUP_CoopGame);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("TrackerBot Tier Full"), STAT_TrackerBotTierFull, STATGROUP_CoopGame);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("TrackerBot Tier Reduced"), STAT_TrackerBotTierReduced, STATGROUP_CoopGame);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("TrackerBot Tier Asleep"), STAT_TrackerBotTierAsleep, STATGROUP_CoopGame);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("TrackerBot Simulating Physics"), STAT_TrackerBotSimulatingPhysics, STATGROUP_CoopGame);
+DECLARE_DWORD_COUNTER_STAT(TEXT("TrackerBot Steering Updates"), STAT_TrackerBotSteeringUpdates, STATGROUP_CoopGame);
+DECLARE_DWORD_COUNTER_STAT(TEXT("TrackerBot Steering Updates Skipped"), STAT_TrackerBotSteeringUpdatesSkipped, STATGROUP_CoopGame);
+
+
+static int32 BotSignificanceEnabled = 1;
+FAutoConsoleVariableRef CVARBotSignificanceEnabled(
+	TEXT("COOP.BotSignificance"),
+	BotSignificanceEnabled,
+	TEXT("Steer tracker bots far from the players less often and put the furthest to sleep. 0 keeps every bot on the full tier"),
+	ECVF_Default);
+
+static float BotFullTierDistance = 2500.0f;
+FAutoConsoleVariableRef CVARBotFullTierDistance(
+	TEXT("COOP.BotFullTierDistance"),
+	BotFullTierDistance,
+	TEXT("Bots closer than this to a player, or in view and within twice this, are steered every frame"),
+	ECVF_Default);
+
+static float BotSleepTierDistance = 8000.0f;
+FAutoConsoleVariableRef CVARBotSleepTierDistance(
+	TEXT("COOP.BotSleepTierDistance"),
+	BotSleepTierDistance,
+	TEXT("Bots further than this from every player, and out of view, stop simulating physics"),
+	ECVF_Default);
+
+static int32 TrackerBotKinematicMovement = 1;
+FAutoConsoleVariableRef CVARTrackerBotKinematicMovement(
+	TEXT("COOP.TrackerBotKinematic"),
+	TrackerBotKinematicMovement,
+	TEXT("Roll tracker bots with a kinematic integrator, rigid body physics only after explosions. 0 simulates every bot"),
+	ECVF_Default);
+
+static float BotSeparationRadius = 150.0f;
+FAutoConsoleVariableRef CVARBotSeparationRadius(
+	TEXT("COOP.BotSeparationRadius"),
+	BotSeparationRadius,
+	TEXT("Tracker bots closer than this push away from each other. 0 turns crowd separation off"),
+	ECVF_Default);
+
+static float BotSeparationStrength = 1.0f;
+FAutoConsoleVariableRef CVARBotSeparationStrength(
+	TEXT("COOP.BotSeparationStrength"),
+	BotSeparationStrength,
+	TEXT("Separation force at zero distance, as a fraction of the bots movement force"),
+	ECVF_Default);
+
+static float BotReducedTierInterval = 0.2f;
+FAutoConsoleVariableRef CVARBotReducedTierInterval(
+	TEXT("COOP.BotReducedTierInterval"),
+	BotReducedTierInterval,
+	TEXT("Seconds between steering updates for reduced tier bots"),
+	ECVF_Default);
+
+static float BotSleepTierInterval = 0.5f;
+FAutoConsoleVariableRef CVARBotSleepTierInterval(
+	TEXT("COOP.BotSleepTierInterval"),
+	BotSleepTierInterval,
+	TEXT("Seconds between kinematic moves for sleeping bots"),
+	ECVF_Default);
+
+//Bots per parallel steering task
+static const int32 SteeringBatchSize = 64;
+
+//How often bots are rescored
+static const float SignificanceInterval = 0.25f;
+
+//Bots have to get this much further out before dropping a tier, stops them flickering on a boundary
+static const float TierHysteresis = 1.1f;
+
+//Cosine of the half angle a player is considered to be looking in
+static const float ViewConeCos = 0.5f;
+
+//Sleeping bots never crawl slower than this
+static const float MinKinematicSpeed = 200.0f;
+
+//Added to trigger radii, the target index only knows target centers. About a player capsule
+static const float ProximityTargetRadius = 40.0f;
+
+//How long an explosion hands a bot to the physics engine
+static const float ExplosionPhysicsTime = 2.0f;
+
+
+bool USTrackerBotSubsystem::IsTickable() const
+{
+	return Super::IsTickable() && IsServerWorld();
+}
+
+TStatId USTrackerBotSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(USTrackerBotSubsystem, STATGROUP_Tickables);
+}
+
+void USTrackerBotSubsystem::RegisterBot(ASTrackerBot* Bot)
+{
+	if (!Bot || Bots.Contains(Bot))
+		return;
+
+	const float Now = GetWorld()->TimeSeconds;
+
+	FBodyInstance* Body = Bot->GetMeshComp()->GetBodyInstance();
+	const FVector Extent = Bot->GetMeshComp()->Bounds.BoxExtent;
+
+	Bots.Add(Bot);
+	Bodies.Add(Body);
+	Positions.Add(Bot->GetActorLocation());
+	NextPoints.Add(Bot->GetActorLocation());
+	Forces.Add(FVector::ZeroVector);
+	MovementForces.Add(Bot->GetMovementForce());
+	RequiredDistances.Add(Bot->GetRequiredDistanceToTarget());
+	BlockedTimes.Add(Bot->GetBlockedPathTime());
+	BestDistances.Add(FLT_MAX);
+	LastProgressTimes.Add(Now);
+	Flags.Add(Bot->UsesVelocityChange() ? (uint8)ESTrackerBotSteering::VelocityChange : 0);
+	BotTeams.Add(Bot->GetTeamNum());
+	TriggerRadii.Add(Bot->GetSelfDestructTriggerRadius() + ProximityTargetRadius);
+	Tiers.Add(ESTrackerBotTier::Full);
+	NextUpdateTimes.Add(Now);
+	UpdateDeltas.Add(0.0f);
+	LastUpdateTimes.Add(Now);
+	Velocities.Add(Bot->GetMeshComp()->GetPhysicsLinearVelocity());
+	Masses.Add(FMath::Max(Body->GetBodyMass(), 1.0f));
+	LinearDampings.Add(Body->LinearDamping);
+	Radii.Add(FMath::Max(FMath::Min(Extent.X, Extent.Y), 1.0f));
+	PhysicsUntilTimes.Add(0.0f);
+
+	//New bots start on the full tier until the next scoring
+	TierCounts[(uint8)ESTrackerBotTier::Full]++;
+
+	INC_DWORD_STAT(STAT_TrackerBotSteeredBots);
+}
+
+void USTrackerBotSubsystem::UnregisterBot(ASTrackerBot* Bot)
+{
+	const int32 Index = Bots.Find(Bot);
+	if (Index != INDEX_NONE)
+	{
+		//Leave physics the way the bot expects it
+		Flags[Index] &= ~ESTrackerBotSteering::Kinematic;
+		SetTier(Index, ESTrackerBotTier::Full, GetWorld()->TimeSeconds);
+		UpdatePhysicsState(Index);
+
+		RemoveBotAt(Index);
+	}
+}
+
+void USTrackerBotSubsystem::RemoveBotAt(int32 Index)
+{
+	TierCounts[(uint8)Tiers[Index]]--;
+
+	Bots.RemoveAtSwap(Index, 1, false);
+	Bodies.RemoveAtSwap(Index, 1, false);
+	Positions.RemoveAtSwap(Index, 1, false);
+	NextPoints.RemoveAtSwap(Index, 1, false);
+	Forces.RemoveAtSwap(Index, 1, false);
+	MovementForces.RemoveAtSwap(Index, 1, false);
+	RequiredDistances.RemoveAtSwap(Index, 1, false);
+	BlockedTimes.RemoveAtSwap(Index, 1, false);
+	BestDistances.RemoveAtSwap(Index, 1, false);
+	LastProgressTimes.RemoveAtSwap(Index, 1, false);
+	Flags.RemoveAtSwap(Index, 1, false);
+	BotTeams.RemoveAtSwap(Index, 1, false);
+	TriggerRadii.RemoveAtSwap(Index, 1, false);
+	Tiers.RemoveAtSwap(Index, 1, false);
+	NextUpdateTimes.RemoveAtSwap(Index, 1, false);
+	UpdateDeltas.RemoveAtSwap(Index, 1, false);
+	LastUpdateTimes.RemoveAtSwap(Index, 1, false);
+	Velocities.RemoveAtSwap(Index, 1, false);
+	Masses.RemoveAtSwap(Index, 1, false);
+	LinearDampings.RemoveAtSwap(Index, 1, false);
+	Radii.RemoveAtSwap(Index, 1, false);
+	PhysicsUntilTimes.RemoveAtSwap(Index, 1, false);
+
+	DEC_DWORD_STAT(STAT_TrackerBotSteeredBots);
+}
+
+void USTrackerBotSubsystem::Tick(float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_TrackerBotSteering);
+
+	const float Now = GetWorld()->TimeSeconds;
+
+	if (Now >= NextSignificanceTime)
+	{
+		NextSignificanceTime = Now + SignificanceInterval;
+		UpdateSignificance(Now);
+	}
+
+	//Gather, only for bots due a steering update. Flow field lookups stay on the game thread
+	for (int32 i = Bots.Num() - 1; i >= 0; i--)
+	{
+		ASTrackerBot* Bot = Bots[i];
+		if (!IsValid(Bot))
+		{
+			RemoveBotAt(i);
+			continue;
+		}
+
+		Flags[i] &= (ESTrackerBotSteering::VelocityChange | ESTrackerBotSteering::OnFlowField | ESTrackerBotSteering::Kinematic | ESTrackerBotSteering::ProximityTriggered);
+
+		//Every bot, due or not, so separation sees where everyone is
+		Positions[i] = Bot->GetActorLocation();
+
+		//Back to rolling once an explosion has worn off
+		const bool bKinematic = TrackerBotKinematicMovement > 0 && Now >= PhysicsUntilTimes[i];
+		if (bKinematic != ((Flags[i] & ESTrackerBotSteering::Kinematic) != 0))
+		{
+			Flags[i] ^= ESTrackerBotSteering::Kinematic;
+			UpdatePhysicsState(i);
+		}
+
+		if (Now < NextUpdateTimes[i])
+		{
+			INC_DWORD_STAT(STAT_TrackerBotSteeringUpdatesSkipped);
+			continue;
+		}
+
+		INC_DWORD_STAT(STAT_TrackerBotSteeringUpdates);
+
+		const ESTrackerBotTier Tier = Tiers[i];
+		NextUpdateTimes[i] = Now + (Tier == ESTrackerBotTier::Full ? 0.0f : Tier == ESTrackerBotTier::Reduced ? BotReducedTierInterval : BotSleepTierInterval);
+		UpdateDeltas[i] = Now - LastUpdateTimes[i];
+		LastUpdateTimes[i] = Now;
+
+		bool bOnFlowField = false;
+		const FVector NextPoint = Bot->UpdateSteeringTarget(bOnFlowField);
+
+		//New point, start tracking progress towards it again
+		if (NextPoint != NextPoints[i])
+		{
+			NextPoints[i] = NextPoint;
+			BestDistances[i] = FLT_MAX;
+			LastProgressTimes[i] = Now;
+		}
+
+		Flags[i] = (uint8)((Flags[i] & (ESTrackerBotSteering::VelocityChange | ESTrackerBotSteering::Kinematic | ESTrackerBotSteering::ProximityTriggered))
+			| ESTrackerBotSteering::Due | (bOnFlowField ? ESTrackerBotSteering::OnFlowField : 0));
+	}
+
+	const int32 NumBots = Bots.Num();
+	if (NumBots == 0)
+		return;
+
+	UpdateProximity();
+
+	const bool bSeparation = BotSeparationRadius > 0.0f && NumBots > 1;
+	if (bSeparation)
+	{
+		BuildSeparationGrid();
+	}
+
+	//Steer every due bot, only writes its own slots
+	const int32 NumBatches = FMath::DivideAndRoundUp(NumBots, SteeringBatchSize);
+	ParallelFor(NumBatches, [this, NumBots, Now, bSeparation](int32 Batch)
+	{
+		const int32 End = FMath::Min((Batch + 1) * SteeringBatchSize, NumBots);
+		for (int32 i = Batch * SteeringBatchSize; i < End; i++)
+		{
+			if (!(Flags[i] & ESTrackerBotSteering::Due))
+				continue;
+
+			const FVector ToNextPoint = NextPoints[i] - Positions[i];
+			const float Distance = ToNextPoint.Size();
+			const bool bOnFlowField = (Flags[i] & ESTrackerBotSteering::OnFlowField) != 0;
+
+			if (!bOnFlowField && Distance <= RequiredDistances[i])
+			{
+				Forces[i] = FVector::ZeroVector;
+				Flags[i] |= ESTrackerBotSteering::Reached;
+				continue;
+			}
+
+			//The flow field already leads around whatever is in the way, sleeping bots go through it
+			if (!bOnFlowField && Tiers[i] != ESTrackerBotTier::Asleep)
+			{
+				if (Distance < BestDistances[i] - 10.0f)
+				{
+					BestDistances[i] = Distance;
+					LastProgressTimes[i] = Now;
+				}
+				else if (Now - LastProgressTimes[i] > BlockedTimes[i])
+				{
+					Flags[i] |= ESTrackerBotSteering::Blocked;
+				}
+			}
+
+			Forces[i] = Distance > KINDA_SMALL_NUMBER ? ToNextPoint * (MovementForces[i] / Distance) : FVector::ZeroVector;
+
+			if (bSeparation)
+			{
+				Forces[i] += ComputeSeparation(i);
+			}
+		}
+	}, NumBatches == 1);
+
+	//Path bookkeeping for the few bots that need it
+	for (int32 i = 0; i < NumBots; i++)
+	{
+		if (Flags[i] & ESTrackerBotSteering::Reached)
+		{
+			Bots[i]->OnPathPointReached();
+		}
+		else if ((Flags[i] & ESTrackerBotSteering::Blocked) && Bots[i]->OnPathBlocked())
+		{
+			LastProgressTimes[i] = Now;
+		}
+	}
+
+	//Bots off physics move themselves. Reduced tier bots keep pushing with their last force
+	{
+		SCOPE_CYCLE_COUNTER(STAT_TrackerBotKinematicMove);
+
+		for (int32 i = 0; i < NumBots; i++)
+		{
+			if (Tiers[i] == ESTrackerBotTier::Asleep)
+			{
+				if (Flags[i] & ESTrackerBotSteering::Due)
+				{
+					MoveAsleepBot(i);
+				}
+			}
+			else if (Flags[i] & ESTrackerBotSteering::Kinematic)
+			{
+				IntegrateKinematic(i, DeltaTime);
+			}
+		}
+	}
+
+	//All forces under one scene lock instead of one per bot
+	{
+		SCOPE_CYCLE_COUNTER(STAT_TrackerBotSteeringApply);
+
+		int32 NumSimulating = 0;
+
+		FPhysicsCommand::ExecuteWrite(GetWorld()->GetPhysicsScene(), [this, NumBots, &NumSimulating]()
+		{
+			for (int32 i = 0; i < NumBots; i++)
+			{
+				if (Tiers[i] == ESTrackerBotTier::Asleep || (Flags[i] & ESTrackerBotSteering::Kinematic))
+					continue;
+
+				NumSimulating++;
+
+				if (Forces[i].IsZero() || !Bodies[i]->IsValidBodyInstance())
+					continue;
+
+				FPhysicsInterface::AddForce_AssumesLocked(Bodies[i]->ActorHandle, Forces[i], true, (Flags[i] & ESTrackerBotSteering::VelocityChange) != 0);
+			}
+		});
+
+		SET_DWORD_STAT(STAT_TrackerBotSimulatingPhysics, NumSimulating);
+	}
+
+	if (ASTrackerBot::IsDebugDrawingEnabled())
+	{
+		for (int32 i = 0; i < NumBots; i++)
+		{
+			if (Tiers[i] == ESTrackerBotTier::Full)
+			{
+				Bots[i]->DrawSteeringDebug(NextPoints[i], Forces[i]);
+			}
+		}
+	}
+}
+
+void USTrackerBotSubsystem::UpdateSignificance(float Now)
+{
+	SCOPE_CYCLE_COUNTER(STAT_TrackerBotSignificance);
+
+	//Where the players are and where they look, once for all bots
+	TArray<FVector, TInlineAllocator<8>> ViewLocations;
+	TArray<FVector, TInlineAllocator<8>> ViewDirections;
+
+	for (FConstPlayerControllerIterator It = GetWorld()->GetPlayerControllerIterator(); It; It++)
+	{
+		APlayerController* PC = It->Get();
+		if (PC && PC->GetPawn())
+		{
+			FVector ViewLocation;
+			FRotator ViewRotation;
+			PC->GetPlayerViewPoint(ViewLocation, ViewRotation);
+
+			ViewLocations.Add(ViewLocation);
+			ViewDirections.Add(ViewRotation.Vector());
+		}
+	}
+
+	//No players to be significant to, keep everything as it is
+	if (ViewLocations.Num() == 0)
+		return;
+
+	const float FullDistSquared = FMath::Square(BotFullTierDistance);
+	const float SleepDistSquared = FMath::Square(BotSleepTierDistance);
+
+	for (int32 i = 0; i < Bots.Num(); i++)
+	{
+		if (!BotSignificanceEnabled)
+		{
+			SetTier(i, ESTrackerBotTier::Full, Now);
+			continue;
+		}
+
+		const FVector Location = Bots[i]->GetActorLocation();
+
+		float MinDistSquared = FLT_MAX;
+		bool bInView = false;
+
+		for (int32 View = 0; View < ViewLocations.Num(); View++)
+		{
+			const FVector ToBot = Location - ViewLocations[View];
+			const float DistSquared = ToBot.SizeSquared();
+
+			MinDistSquared = FMath::Min(MinDistSquared, DistSquared);
+			bInView |= FVector::DotProduct(ToBot, ViewDirections[View]) > ViewConeCos * FMath::Sqrt(DistSquared);
+		}
+
+		//Current tier gets some slack before dropping a tier
+		const float Slack = FMath::Square(TierHysteresis);
+		const float FullSlack = Tiers[i] == ESTrackerBotTier::Full ? Slack : 1.0f;
+		const float SleepSlack = Tiers[i] == ESTrackerBotTier::Asleep ? 1.0f : Slack;
+
+		ESTrackerBotTier NewTier = ESTrackerBotTier::Reduced;
+		if (MinDistSquared < FullDistSquared * FullSlack || (bInView && MinDistSquared < FullDistSquared * 4.0f * FullSlack))
+		{
+			NewTier = ESTrackerBotTier::Full;
+		}
+		else if (!bInView && MinDistSquared > SleepDistSquared * SleepSlack)
+		{
+			NewTier = ESTrackerBotTier::Asleep;
+		}
+
+		SetTier(i, NewTier, Now);
+	}
+
+	SET_DWORD_STAT(STAT_TrackerBotTierFull, TierCounts[(uint8)ESTrackerBotTier::Full]);
+	SET_DWORD_STAT(STAT_TrackerBotTierReduced, TierCounts[(uint8)ESTrackerBotTier::Reduced]);
+	SET_DWORD_STAT(STAT_TrackerBotTierAsleep, TierCounts[(uint8)ESTrackerBotTier::Asleep]);
+}
+
+void USTrackerBotSubsystem::SetTier(int32 Index, ESTrackerBotTier NewTier, float Now)
+{
+	const ESTrackerBotTier OldTier = Tiers[Index];
+	if (OldTier == NewTier)
+		return;
+
+	TierCounts[(uint8)OldTier]--;
+	TierCounts[(uint8)NewTier]++;
+
+	Tiers[Index] = NewTier;
+	UpdatePhysicsState(Index);
+	Bots[Index]->SetLowSignificance(NewTier != ESTrackerBotTier::Full);
+
+	//Steer straight away on the new tier
+	NextUpdateTimes[Index] = Now;
+}
+
+void USTrackerBotSubsystem::MoveAsleepBot(int32 Index)
+{
+	const FVector Direction = Forces[Index].GetSafeNormal2D();
+	if (Direction.IsZero())
+		return;
+
+	ASTrackerBot* Bot = Bots[Index];
+	const float HalfHeight = Bot->GetMeshComp()->Bounds.BoxExtent.Z;
+
+	//Keep rolling at the speed we had
+	Velocities[Index] = Direction * FMath::Max(Velocities[Index].Size2D(), MinKinematicSpeed);
+
+	FVector NewLocation = Positions[Index] + Velocities[Index] * UpdateDeltas[Index];
+
+	//Stay on the floor
+	FHitResult Hit;
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(TrackerBotSleepFloor), false, Bot);
+	const FVector TraceStart = NewLocation + FVector(0.0f, 0.0f, HalfHeight * 2.0f);
+	const FVector TraceEnd = NewLocation - FVector(0.0f, 0.0f, HalfHeight * 4.0f);
+	if (GetWorld()->LineTraceSingleByChannel(Hit, TraceStart, TraceEnd, ECC_Visibility, QueryParams))
+	{
+		NewLocation.Z = Hit.ImpactPoint.Z + HalfHeight;
+	}
+
+	Bot->SetActorLocation(NewLocation, false, nullptr, ETeleportType::TeleportPhysics);
+	Positions[Index] = NewLocation;
+}
+
+void USTrackerBotSubsystem::WakePhysics(ASTrackerBot* Bot)
+{
+	const int32 Index = Bots.Find(Bot);
+	if (Index == INDEX_NONE)
+		return;
+
+	PhysicsUntilTimes[Index] = GetWorld()->TimeSeconds + ExplosionPhysicsTime;
+
+	if (Flags[Index] & ESTrackerBotSteering::Kinematic)
+	{
+		Flags[Index] &= ~ESTrackerBotSteering::Kinematic;
+		UpdatePhysicsState(Index);
+	}
+}
+
+void USTrackerBotSubsystem::AddImpulse(ASTrackerBot* Bot, const FVector& Impulse, bool bVelChange)
+{
+	const int32 Index = Bots.Find(Bot);
+	if (Index == INDEX_NONE || Bot->GetMeshComp()->IsSimulatingPhysics())
+		return;
+
+	Velocities[Index] += bVelChange ? Impulse : Impulse / FMath::Max(Masses[Index], KINDA_SMALL_NUMBER);
+}
+
+void USTrackerBotSubsystem::UpdatePhysicsState(int32 Index)
+{
+	UStaticMeshComponent* MeshComp = Bots[Index]->GetMeshComp();
+
+	const bool bSimulate = Tiers[Index] != ESTrackerBotTier::Asleep && !(Flags[Index] & ESTrackerBotSteering::Kinematic);
+	if (bSimulate == MeshComp->IsSimulatingPhysics())
+		return;
+
+	if (bSimulate)
+	{
+		//Pick up where the kinematic move left off
+		MeshComp->SetSimulatePhysics(true);
+		MeshComp->SetPhysicsLinearVelocity(Velocities[Index]);
+	}
+	else
+	{
+		Velocities[Index] = MeshComp->GetPhysicsLinearVelocity();
+		MeshComp->SetSimulatePhysics(false);
+	}
+}
+
+void USTrackerBotSubsystem::IntegrateKinematic(int32 Index, float DeltaTime)
+{
+	ASTrackerBot* Bot = Bots[Index];
+	FVector& Velocity = Velocities[Index];
+
+	//Same as AddForce on the body, a velocity change ignores mass
+	const FVector Acceleration = (Flags[Index] & ESTrackerBotSteering::VelocityChange) ? Forces[Index] : Forces[Index] / Masses[Index];
+
+	Velocity += (Acceleration + FVector(0.0f, 0.0f, GetWorld()->GetGravityZ())) * DeltaTime;
+	Velocity *= FMath::Max(0.0f, 1.0f - LinearDampings[Index] * DeltaTime);
+
+	const FVector OldLocation = Positions[Index];
+	FVector Location = OldLocation;
+	FVector Delta = Velocity * DeltaTime;
+
+	//Players and level geometry block us, other bots don't
+	static const FCollisionObjectQueryParams BlockingObjects(ECC_TO_BITFIELD(ECC_WorldStatic) | ECC_TO_BITFIELD(ECC_Pawn));
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(TrackerBotKinematicMove), false, Bot);
+	const FCollisionShape Sphere = FCollisionShape::MakeSphere(Radii[Index]);
+
+	//Sweep, then slide along whatever we hit
+	for (int32 Iteration = 0; Iteration < 3 && !Delta.IsNearlyZero(); Iteration++)
+	{
+		FHitResult Hit;
+		if (!GetWorld()->SweepSingleByObjectType(Hit, Location, Location + Delta, FQuat::Identity, BlockingObjects, Sphere, QueryParams))
+		{
+			Location += Delta;
+			break;
+		}
+
+		if (Hit.bStartPenetrating)
+		{
+			Location += Hit.Normal * (Hit.PenetrationDepth + 0.1f);
+			continue;
+		}
+
+		Location = Hit.Location;
+
+		Velocity -= Hit.Normal * FMath::Min(FVector::DotProduct(Velocity, Hit.Normal), 0.0f);
+
+		Delta *= 1.0f - Hit.Time;
+		Delta -= Hit.Normal * FMath::Min(FVector::DotProduct(Delta, Hit.Normal), 0.0f);
+	}
+
+	//Roll about the axis across our travel, looks like the physics ball did
+	FQuat Rotation = Bot->GetActorQuat();
+
+	const FVector Moved = Location - OldLocation;
+	const float RollDistance = Moved.Size2D();
+	if (RollDistance > KINDA_SMALL_NUMBER)
+	{
+		const FVector Axis = FVector::CrossProduct(FVector::UpVector, Moved.GetSafeNormal2D());
+		Rotation = FQuat(Axis, RollDistance / Radii[Index]) * Rotation;
+	}
+
+	Bot->SetActorLocationAndRotation(Location, Rotation, false, nullptr, ETeleportType::TeleportPhysics);
+	Positions[Index] = Location;
+}
+
+void USTrackerBotSubsystem::BuildSeparationGrid()
+{
+	SCOPE_CYCLE_COUNTER(STAT_TrackerBotSeparationGrid);
+
+	const int32 NumBots = Bots.Num();
+	const float InvCellSize = 1.0f / BotSeparationRadius;
+
+	//X in the high bits, Y in the low bits
+	CellKeys.Reset(NumBots);
+	for (int32 i = 0; i < NumBots; i++)
+	{
+		const uint32 CellX = (uint32)FMath::FloorToInt(Positions[i].X * InvCellSize);
+		const uint32 CellY = (uint32)FMath::FloorToInt(Positions[i].Y * InvCellSize);
+		const uint64 CellKey = ((uint64)CellX << 32) | CellY;
+
+		CellKeys.Add(CellKey);
+	}
+
+	SortedBots.Reset(NumBots);
+	for (int32 i = 0; i < NumBots; i++)
+	{
+		SortedBots.Add(i);
+	}
+	//One sort groups every cell into a run
+	SortedBots.Sort([this](int32 A, int32 B) { return CellKeys[A] < CellKeys[B]; });
+
+	CellStarts.Reset();
+	for (int32 Slot = 0; Slot < NumBots; Slot++)
+	{
+		const uint64 CellKey = CellKeys[SortedBots[Slot]];
+		if (Slot == 0 || CellKey != CellKeys[SortedBots[Slot - 1]])
+		{
+			CellStarts.Add(CellKey, Slot);
+		}
+	}
+}
+
+FVector USTrackerBotSubsystem::ComputeSeparation(int32 Index) const
+{
+	const float Radius = BotSeparationRadius;
+	const float RadiusSquared = Radius * Radius;
+	const float InvCellSize = 1.0f / Radius;
+
+	//Separation is flat, height differences don't push bots into the floor
+	const VectorRegister FlatMask = MakeVectorRegister(1.0f, 1.0f, 0.0f, 0.0f);
+	const VectorRegister Self = VectorMultiply(VectorLoadFloat3_W0(&Positions[Index]), FlatMask);
+
+	VectorRegister Push = VectorZero();
+
+	const int32 CenterX = FMath::FloorToInt(Positions[Index].X * InvCellSize);
+	const int32 CenterY = FMath::FloorToInt(Positions[Index].Y * InvCellSize);
+
+	for (int32 CellX = CenterX - 1; CellX <= CenterX + 1; CellX++)
+	{
+		for (int32 CellY = CenterY - 1; CellY <= CenterY + 1; CellY++)
+		{
+			const uint64 CellKey = ((uint64)(uint32)CellX << 32) | (uint32)CellY;
+			const int32* Start = CellStarts.Find(CellKey);
+			if (!Start)
+				continue;
+
+			for (int32 Slot = *Start; Slot < SortedBots.Num() && CellKeys[SortedBots[Slot]] == CellKey; Slot++)
+			{
+				const int32 Other = SortedBots[Slot];
+				if (Other == Index)
+					continue;
+
+				const VectorRegister Away = VectorSubtract(Self, VectorMultiply(VectorLoadFloat3_W0(&Positions[Other]), FlatMask));
+
+				float DistSquared;
+				VectorStoreFloat1(VectorDot3(Away, Away), &DistSquared);
+				if (DistSquared >= RadiusSquared || DistSquared < KINDA_SMALL_NUMBER)
+					continue;
+
+				//Stronger the closer they are, nothing at the edge of the radius
+				const float Distance = FMath::Sqrt(DistSquared);
+				Push = VectorMultiplyAdd(Away, VectorSetFloat1((1.0f - Distance / Radius) / Distance), Push);
+			}
+		}
+	}
+
+	FVector Separation;
+	VectorStoreFloat3(Push, &Separation);
+	return Separation * (MovementForces[Index] * BotSeparationStrength);
+}
+
+void USTrackerBotSubsystem::UpdateProximity()
+{
+	SCOPE_CYCLE_COUNTER(STAT_TrackerBotProximity);
+
+	USTargetIndexSubsystem* TargetIndex = GetWorld()->GetSubsystem<USTargetIndexSubsystem>();
+	if (!TargetIndex)
+		return;
+
+	for (const TPair<uint8, FSTargetTeam>& Pair : TargetIndex->GetTeams())
+	{
+		const FSTargetTeam& Team = Pair.Value;
+		const int32 NumTargets = Team.Num();
+
+		for (int32 i = 0; i < Bots.Num(); i++)
+		{
+			if (BotTeams[i] == Pair.Key || (Flags[i] & ESTrackerBotSteering::ProximityTriggered))
+				continue;
+
+			const FVector& Location = Positions[i];
+			const float RadiusSquared = FMath::Square(TriggerRadii[i]);
+
+			bool bTriggered = false;
+			int32 t = 0;
+
+			//The bot may turn down a pawn in range, keep looking until one sets it off
+			auto TryTrigger = [&](int32 Target)
+			{
+				APawn* Hostile = Team.Pawns[Target].Get();
+				if (Hostile && Bots[i]->OnHostileNearby(Hostile))
+				{
+					Flags[i] |= ESTrackerBotSteering::ProximityTriggered;
+					bTriggered = true;
+				}
+			};
+
+			const VectorRegister BotX = VectorSetFloat1(Location.X);
+			const VectorRegister BotY = VectorSetFloat1(Location.Y);
+			const VectorRegister BotZ = VectorSetFloat1(Location.Z);
+			const VectorRegister Radius = VectorSetFloat1(RadiusSquared);
+
+			for (; t + 4 <= NumTargets && !bTriggered; t += 4)
+			{
+				VectorRegister DX = VectorSubtract(VectorLoad(&Team.X[t]), BotX);
+				VectorRegister DY = VectorSubtract(VectorLoad(&Team.Y[t]), BotY);
+				VectorRegister DZ = VectorSubtract(VectorLoad(&Team.Z[t]), BotZ);
+
+				VectorRegister DistSquared = VectorMultiplyAdd(DZ, DZ, VectorMultiplyAdd(DY, DY, VectorMultiply(DX, DX)));
+				if (!VectorAnyGreaterThan(Radius, DistSquared))
+					continue;
+
+				float Distances[4];
+				VectorStore(DistSquared, Distances);
+
+				for (int32 Lane = 0; Lane < 4 && !bTriggered; Lane++)
+				{
+					if (Distances[Lane] < RadiusSquared)
+					{
+						TryTrigger(t + Lane);
+					}
+				}
+			}
+
+			for (; t < NumTargets && !bTriggered; t++)
+			{
+				if (FVector::DistSquared(FVector(Team.X[t], Team.Y[t], Team.Z[t]), Location) < RadiusSquared)
+				{
+					TryTrigger(t);
+				}
+			}
+		}
+	}
+}
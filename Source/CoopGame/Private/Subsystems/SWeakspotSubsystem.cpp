@@ -0,0 +1,182 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Subsystems/SWeakspotSubsystem.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "Components/SkeletalMeshComponent.h"
+#include "PhysicsEngine/PhysicsAsset.h"
+#include "PhysicsEngine/SkeletalBodySetup.h"
+#include "PhysicalMaterials/PhysicalMaterial.h"
+#include "SCharacter.h"
+#include "AI/STrackerBot.h"
+#include "../../CoopGame.h"
+
+
+DECLARE_CYCLE_STAT(TEXT("Weakspot Resolve"), STAT_WeakspotResolve, STATGROUP_CoopGame);
+
+
+static int32 WeaponComplexTraces = 0;
+FAutoConsoleVariableRef CVARWeaponComplexTraces(
+	TEXT("COOP.WeaponComplexTraces"),
+	WeaponComplexTraces,
+	TEXT("Weapons trace complex collision. 0 traces simple bodies and finds weakspots from the hit body"),
+	ECVF_Default);
+
+//Body has no surface of its own, use the hit physical material
+static const uint8 SurfaceFromHit = 0xFF;
+
+
+USWeakspotSubsystem::USWeakspotSubsystem()
+{
+	WeakspotBoneNames.Add("head");
+}
+
+bool USWeakspotSubsystem::ShouldCreateSubsystem(UObject* Outer) const
+{
+	UWorld* World = Cast<UWorld>(Outer);
+	return World && World->IsGameWorld();
+}
+
+bool USWeakspotSubsystem::UseComplexTraces()
+{
+	return WeaponComplexTraces > 0;
+}
+
+EPhysicalSurface USWeakspotSubsystem::ResolveSurfaceType(const FHitResult& Hit)
+{
+	SCOPE_CYCLE_COUNTER(STAT_WeakspotResolve);
+
+	USkeletalMeshComponent* SkelComp = Cast<USkeletalMeshComponent>(Hit.GetComponent());
+	UPhysicsAsset* PhysicsAsset = SkelComp ? SkelComp->GetPhysicsAsset() : nullptr;
+
+	if (!UseComplexTraces() && PhysicsAsset && Hit.BoneName != NAME_None)
+	{
+		const TArray<uint8>& SurfaceTable = GetSurfaceTable(PhysicsAsset);
+
+		int32 BodyIndex = PhysicsAsset->FindBodyIndex(Hit.BoneName);
+		if (SurfaceTable.IsValidIndex(BodyIndex) && SurfaceTable[BodyIndex] != SurfaceFromHit)
+		{
+			return (EPhysicalSurface)SurfaceTable[BodyIndex];
+		}
+	}
+
+	return UPhysicalMaterial::DetermineSurfaceType(Hit.PhysMaterial.Get());
+}
+
+//Built once per physics asset
+const TArray<uint8>& USWeakspotSubsystem::GetSurfaceTable(UPhysicsAsset* PhysicsAsset)
+{
+	TArray<uint8>* ExistingTable = SurfaceTables.Find(PhysicsAsset);
+	if (ExistingTable)
+		return *ExistingTable;
+
+	TArray<uint8>& SurfaceTable = SurfaceTables.Add(PhysicsAsset);
+	SurfaceTable.Init(SurfaceFromHit, PhysicsAsset->SkeletalBodySetups.Num());
+
+	for (int32 BodyIndex = 0; BodyIndex < PhysicsAsset->SkeletalBodySetups.Num(); BodyIndex++)
+	{
+		USkeletalBodySetup* BodySetup = PhysicsAsset->SkeletalBodySetups[BodyIndex];
+		if (!BodySetup)
+			continue;
+
+		//The body material wins, same as what a complex trace would return
+		if (BodySetup->PhysMaterial)
+		{
+			SurfaceTable[BodyIndex] = UPhysicalMaterial::DetermineSurfaceType(BodySetup->PhysMaterial);
+		}
+		else if (WeakspotBoneNames.Contains(BodySetup->BoneName))
+		{
+			SurfaceTable[BodyIndex] = SURFACE_FLESHVULNERABLE;
+		}
+	}
+
+	return SurfaceTable;
+}
+
+
+//Compares the cost of complex traces against simple traces + body lookup on every character and tracker bot in the level
+static void BenchmarkWeaponTraces(const TArray<FString>& Args, UWorld* World)
+{
+	USWeakspotSubsystem* Weakspots = World ? World->GetSubsystem<USWeakspotSubsystem>() : nullptr;
+	if (!Weakspots)
+		return;
+
+	int32 ShotsPerTarget = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 100;
+
+	TArray<AActor*> Targets;
+	for (TActorIterator<ASCharacter> It(World); It; ++It)
+	{
+		Targets.Add(*It);
+	}
+	for (TActorIterator<ASTrackerBot> It(World); It; ++It)
+	{
+		Targets.Add(*It);
+	}
+
+	if (Targets.Num() == 0)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("COOP.BenchmarkWeaponTraces: no ASCharacter or ASTrackerBot targets in the level"));
+		return;
+	}
+
+	//Same shots for both paths, from 1000 units out at a random point in the target bounds
+	FRandomStream Stream(1337);
+	TArray<TPair<FVector, FVector>> Shots;
+	Shots.Reserve(Targets.Num() * ShotsPerTarget);
+	for (AActor* Target : Targets)
+	{
+		FVector Origin, Extent;
+		Target->GetActorBounds(true, Origin, Extent);
+
+		for (int32 i = 0; i < ShotsPerTarget; i++)
+		{
+			FVector Aim = Origin + FVector(Stream.FRandRange(-1, 1), Stream.FRandRange(-1, 1), Stream.FRandRange(-1, 1)) * Extent;
+			FVector Start = Aim + Stream.GetUnitVector() * 1000.0f;
+			Shots.Emplace(Start, Aim + (Aim - Start));
+		}
+	}
+
+	FCollisionQueryParams ComplexParams(SCENE_QUERY_STAT(WeaponTraceBenchmark), true);
+	ComplexParams.bReturnPhysicalMaterial = true;
+
+	FCollisionQueryParams SimpleParams(SCENE_QUERY_STAT(WeaponTraceBenchmark), false);
+	SimpleParams.bReturnPhysicalMaterial = true;
+
+	TArray<uint8> ComplexSurfaces;
+	ComplexSurfaces.Reserve(Shots.Num());
+
+	FHitResult Hit;
+
+	double StartTime = FPlatformTime::Seconds();
+	for (const TPair<FVector, FVector>& Shot : Shots)
+	{
+		bool bHit = World->LineTraceSingleByChannel(Hit, Shot.Key, Shot.Value, COLLISION_WEAPON, ComplexParams);
+		ComplexSurfaces.Add(bHit ? UPhysicalMaterial::DetermineSurfaceType(Hit.PhysMaterial.Get()) : SurfaceType_Default);
+	}
+	double ComplexTime = FPlatformTime::Seconds() - StartTime;
+
+	int32 Matches = 0;
+	int32 WeakspotHits = 0;
+
+	StartTime = FPlatformTime::Seconds();
+	for (int32 i = 0; i < Shots.Num(); i++)
+	{
+		bool bHit = World->LineTraceSingleByChannel(Hit, Shots[i].Key, Shots[i].Value, COLLISION_WEAPON, SimpleParams);
+		EPhysicalSurface Surface = bHit ? Weakspots->ResolveSurfaceType(Hit) : SurfaceType_Default;
+
+		Matches += (Surface == ComplexSurfaces[i]) ? 1 : 0;
+		WeakspotHits += (Surface == SURFACE_FLESHVULNERABLE) ? 1 : 0;
+	}
+	double SimpleTime = FPlatformTime::Seconds() - StartTime;
+
+	UE_LOG(LogTemp, Log, TEXT("COOP.BenchmarkWeaponTraces: %d shots at %d targets"), Shots.Num(), Targets.Num());
+	UE_LOG(LogTemp, Log, TEXT("  Complex: %.2f us/shot"), ComplexTime * 1000000.0 / Shots.Num());
+	UE_LOG(LogTemp, Log, TEXT("  Simple + body lookup: %.2f us/shot (%.2fx)"), SimpleTime * 1000000.0 / Shots.Num(), ComplexTime / FMath::Max(SimpleTime, 0.000001));
+	UE_LOG(LogTemp, Log, TEXT("  Same surface: %d/%d, weakspot hits: %d"), Matches, Shots.Num(), WeakspotHits);
+}
+
+static FAutoConsoleCommandWithWorldAndArgs BenchmarkWeaponTracesCmd(
+	TEXT("COOP.BenchmarkWeaponTraces"),
+	TEXT("Time complex weapon traces against simple traces with weakspot lookup. Optional arg: shots per target"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&BenchmarkWeaponTraces));
@@ -0,0 +1,211 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Subsystems/SWeaponFXSubsystem.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+#include "GameFramework/WorldSettings.h"
+#include "Camera/PlayerCameraManager.h"
+#include "Particles/ParticleSystem.h"
+#include "Particles/ParticleSystemComponent.h"
+#include "../../CoopGame.h"
+
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("WeaponFX Spawned"), STAT_WeaponFXSpawned, STATGROUP_CoopGame);
+DECLARE_DWORD_COUNTER_STAT(TEXT("WeaponFX Reused"), STAT_WeaponFXReused, STATGROUP_CoopGame);
+DECLARE_DWORD_COUNTER_STAT(TEXT("WeaponFX Culled"), STAT_WeaponFXCulled, STATGROUP_CoopGame);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("WeaponFX Pooled Components"), STAT_WeaponFXPooled, STATGROUP_CoopGame);
+
+
+static int32 WeaponFXPoolSize = 16;
+FAutoConsoleVariableRef CVARWeaponFXPoolSize(
+	TEXT("COOP.WeaponFXPoolSize"),
+	WeaponFXPoolSize,
+	TEXT("Most particle components kept per weapon effect"),
+	ECVF_Default);
+
+static float WeaponFXCullDistance = 6000.0f;
+FAutoConsoleVariableRef CVARWeaponFXCullDistance(
+	TEXT("COOP.WeaponFXCullDistance"),
+	WeaponFXCullDistance,
+	TEXT("Weapon effects further than this from the local camera are skipped"),
+	ECVF_Default);
+
+//Extra size given to effects when checking if they are in view
+static const float WeaponFXRadius = 200.0f;
+
+
+bool USWeaponFXSubsystem::ShouldCreateSubsystem(UObject* Outer) const
+{
+	UWorld* World = Cast<UWorld>(Outer);
+	return World && World->IsGameWorld() && !IsRunningDedicatedServer();
+}
+
+void USWeaponFXSubsystem::Deinitialize()
+{
+	for (TPair<UParticleSystem*, FSWeaponFXPool>& Pair : Pools)
+	{
+		for (UParticleSystemComponent* Comp : Pair.Value.Components)
+		{
+			if (Comp)
+			{
+				Comp->DestroyComponent();
+			}
+		}
+	}
+	Pools.Empty();
+
+	Super::Deinitialize();
+}
+
+UParticleSystemComponent* USWeaponFXSubsystem::PlayEffectAtLocation(UParticleSystem* Effect, const FVector& Location, const FRotator& Rotation, bool bAlwaysSignificant)
+{
+	if (!Effect)
+		return nullptr;
+
+	if (!bAlwaysSignificant && !IsLocationSignificant(Location))
+	{
+		NumCulled++;
+		INC_DWORD_STAT(STAT_WeaponFXCulled);
+		return nullptr;
+	}
+
+	UParticleSystemComponent* Comp = AcquireComponent(Effect);
+	if (Comp->GetAttachParent())
+	{
+		Comp->DetachFromComponent(FDetachmentTransformRules::KeepWorldTransform);
+	}
+
+	Comp->SetWorldLocationAndRotation(Location, Rotation);
+	Comp->ActivateSystem(true);
+
+	return Comp;
+}
+
+UParticleSystemComponent* USWeaponFXSubsystem::PlayEffectAttached(UParticleSystem* Effect, USceneComponent* AttachTo, FName SocketName, bool bAlwaysSignificant)
+{
+	if (!Effect || !AttachTo)
+		return nullptr;
+
+	if (!bAlwaysSignificant && !IsLocationSignificant(AttachTo->GetSocketLocation(SocketName)))
+	{
+		NumCulled++;
+		INC_DWORD_STAT(STAT_WeaponFXCulled);
+		return nullptr;
+	}
+
+	UParticleSystemComponent* Comp = AcquireComponent(Effect);
+	if (Comp->GetAttachParent() != AttachTo || Comp->GetAttachSocketName() != SocketName)
+	{
+		Comp->AttachToComponent(AttachTo, FAttachmentTransformRules::SnapToTargetNotIncludingScale, SocketName);
+	}
+
+	Comp->ActivateSystem(true);
+
+	return Comp;
+}
+
+UParticleSystemComponent* USWeaponFXSubsystem::PlayTracerEffect(UParticleSystem* Effect, const FVector& Start, const FVector& End, FName TargetParamName)
+{
+	if (!Effect)
+		return nullptr;
+
+	//Tracers can start off screen and fly through view, check the whole path
+	if (!IsSegmentSignificant(Start, End))
+	{
+		NumCulled++;
+		INC_DWORD_STAT(STAT_WeaponFXCulled);
+		return nullptr;
+	}
+
+	UParticleSystemComponent* Comp = PlayEffectAtLocation(Effect, Start, FRotator::ZeroRotator, true);
+	Comp->SetVectorParameter(TargetParamName, End);
+
+	return Comp;
+}
+
+//Idle component for the effect, a new one while under budget, otherwise the oldest one is restarted
+UParticleSystemComponent* USWeaponFXSubsystem::AcquireComponent(UParticleSystem* Effect)
+{
+	FSWeaponFXPool& Pool = Pools.FindOrAdd(Effect);
+
+	for (UParticleSystemComponent* Comp : Pool.Components)
+	{
+		if (!Comp->IsActive())
+		{
+			NumReused++;
+			INC_DWORD_STAT(STAT_WeaponFXReused);
+			return Comp;
+		}
+	}
+
+	if (Pool.Components.Num() < FMath::Max(WeaponFXPoolSize, 1))
+	{
+		//same setup as UGameplayStatics::SpawnEmitterAtLocation, minus the auto destroy
+		UParticleSystemComponent* Comp = NewObject<UParticleSystemComponent>(GetWorld()->GetWorldSettings());
+		Comp->bAutoDestroy = false;
+		Comp->bAutoActivate = false;
+		Comp->SetTemplate(Effect);
+		Comp->RegisterComponentWithWorld(GetWorld());
+
+		Pool.Components.Add(Comp);
+
+		NumSpawned++;
+		INC_DWORD_STAT(STAT_WeaponFXSpawned);
+		INC_DWORD_STAT(STAT_WeaponFXPooled);
+		return Comp;
+	}
+
+	UParticleSystemComponent* Comp = Pool.Components[Pool.NextIndex % Pool.Components.Num()];
+	Pool.NextIndex = (Pool.NextIndex + 1) % Pool.Components.Num();
+
+	NumReused++;
+	INC_DWORD_STAT(STAT_WeaponFXReused);
+	return Comp;
+}
+
+bool USWeaponFXSubsystem::GetLocalView(FVector& OutLocation, FVector& OutDirection, float& OutCosHalfFOV) const
+{
+	APlayerController* PC = GetWorld()->GetFirstPlayerController();
+	if (!PC || !PC->PlayerCameraManager)
+		return false;
+
+	OutLocation = PC->PlayerCameraManager->GetCameraLocation();
+	OutDirection = PC->PlayerCameraManager->GetCameraRotation().Vector();
+
+	//FOV is horizontal, which covers the vertical too. Pad it for wide screens and camera turns
+	float HalfFOV = FMath::Min(PC->PlayerCameraManager->GetFOVAngle() * 0.5f + 15.0f, 89.0f);
+	OutCosHalfFOV = FMath::Cos(FMath::DegreesToRadians(HalfFOV));
+	return true;
+}
+
+bool USWeaponFXSubsystem::IsLocationSignificant(const FVector& Location) const
+{
+	FVector ViewLocation, ViewDirection;
+	float CosHalfFOV;
+	if (!GetLocalView(ViewLocation, ViewDirection, CosHalfFOV))
+		return true;
+
+	FVector ToLocation = Location - ViewLocation;
+	float Distance = ToLocation.Size();
+
+	if (Distance <= WeaponFXRadius)
+		return true;
+
+	if (Distance > WeaponFXCullDistance)
+		return false;
+
+	return (ToLocation | ViewDirection) >= (Distance * CosHalfFOV) - WeaponFXRadius;
+}
+
+bool USWeaponFXSubsystem::IsSegmentSignificant(const FVector& Start, const FVector& End) const
+{
+	FVector ViewLocation, ViewDirection;
+	float CosHalfFOV;
+	if (!GetLocalView(ViewLocation, ViewDirection, CosHalfFOV))
+		return true;
+
+	//Closest point catches tracers flying past the camera
+	return IsLocationSignificant(FMath::ClosestPointOnSegment(ViewLocation, Start, End))
+		|| IsLocationSignificant(Start) || IsLocationSignificant(End);
+}
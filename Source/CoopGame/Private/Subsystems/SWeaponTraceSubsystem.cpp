@@ -0,0 +1,157 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Subsystems/SWeaponTraceSubsystem.h"
+#include "Subsystems/SLagCompensationSubsystem.h"
+#include "Engine/World.h"
+#include "SWeapon.h"
+#include "../../CoopGame.h"
+
+
+DECLARE_CYCLE_STAT(TEXT("WeaponTrace Flush"), STAT_WeaponTraceFlush, STATGROUP_CoopGame);
+DECLARE_CYCLE_STAT(TEXT("WeaponTrace Resolve"), STAT_WeaponTraceResolve, STATGROUP_CoopGame);
+DECLARE_DWORD_COUNTER_STAT(TEXT("WeaponTrace Async Traces"), STAT_WeaponTracesAsync, STATGROUP_CoopGame);
+DECLARE_DWORD_COUNTER_STAT(TEXT("WeaponTrace Rewound Traces"), STAT_WeaponTracesRewound, STATGROUP_CoopGame);
+DECLARE_DWORD_COUNTER_STAT(TEXT("WeaponTrace Dropped Results"), STAT_WeaponTracesDropped, STATGROUP_CoopGame);
+DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT("WeaponTrace Avg Latency (ms)"), STAT_WeaponTraceLatency, STATGROUP_CoopGame);
+
+
+static int32 AsyncWeaponTraces = 1;
+FAutoConsoleVariableRef CVARAsyncWeaponTraces(
+	TEXT("COOP.AsyncWeaponTraces"),
+	AsyncWeaponTraces,
+	TEXT("Batch weapon traces per frame and run them through the async trace API"),
+	ECVF_Default);
+
+
+void USWeaponTraceSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	QueuedShots.Reserve(32);
+	InFlightShots.Reserve(32);
+
+	TraceDelegate.BindUObject(this, &USWeaponTraceSubsystem::OnTraceCompleted);
+}
+
+TStatId USWeaponTraceSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(USWeaponTraceSubsystem, STATGROUP_Tickables);
+}
+
+bool USWeaponTraceSubsystem::IsEnabled() const
+{
+	return AsyncWeaponTraces > 0;
+}
+
+void USWeaponTraceSubsystem::QueueShot(ASWeapon* Weapon, const FSWeaponShot& Shot)
+{
+	FSPendingShot& Pending = QueuedShots.AddDefaulted_GetRef();
+	Pending.Weapon = Weapon;
+	Pending.Result.Shot = Shot;
+	Pending.QueueTime = FPlatformTime::Seconds();
+	Pending.bTraced = false;
+}
+
+//Runs after all actors ticked, so every shot of this frame is queued
+void USWeaponTraceSubsystem::Tick(float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_WeaponTraceFlush);
+
+	//Results for last frames batch have been delivered by now
+	ResolveInFlightShots();
+	InFlightShots.Reset();
+
+	if (QueuedShots.Num() == 0)
+		return;
+
+	Swap(QueuedShots, InFlightShots);
+
+	USLagCompensationSubsystem* LagCompensation = GetWorld()->GetSubsystem<USLagCompensationSubsystem>();
+	const bool bCanRewind = LagCompensation && LagCompensation->IsEnabled();
+
+	for (int32 i = 0; i < InFlightShots.Num(); i++)
+	{
+		FSPendingShot& Pending = InFlightShots[i];
+		const FSWeaponShot& Shot = Pending.Result.Shot;
+
+		ASWeapon* Weapon = Pending.Weapon.Get();
+		if (!Weapon)
+			continue;
+
+		if (bCanRewind && Shot.LagCompensationTimestamp >= 0.0f)
+		{
+			//Async traces run after the rewind is undone, trace these now
+			INC_DWORD_STAT(STAT_WeaponTracesRewound);
+
+			FSLagCompensationScope Rewind(GetWorld(), Shot.LagCompensationTimestamp, Shot.TraceStart, Shot.TraceEnd);
+
+			Pending.Result.bBlockingHit = GetWorld()->LineTraceSingleByChannel(Pending.Result.Hit, Shot.TraceStart, Shot.TraceEnd,
+				COLLISION_WEAPON, Weapon->GetTraceQueryParams());
+			Pending.bTraced = true;
+			continue;
+		}
+
+		INC_DWORD_STAT(STAT_WeaponTracesAsync);
+
+		GetWorld()->AsyncLineTraceByChannel(EAsyncTraceType::Single, Shot.TraceStart, Shot.TraceEnd,
+			COLLISION_WEAPON, Weapon->GetTraceQueryParams(), FCollisionResponseParams::DefaultResponseParam, &TraceDelegate, i);
+	}
+
+	SET_FLOAT_STAT(STAT_WeaponTraceLatency, AverageLatencyMs);
+}
+
+void USWeaponTraceSubsystem::OnTraceCompleted(const FTraceHandle& Handle, FTraceDatum& Data)
+{
+	if (!InFlightShots.IsValidIndex(Data.UserData))
+		return;
+
+	FSPendingShot& Pending = InFlightShots[Data.UserData];
+	if (Pending.bTraced)
+		return;
+
+	Pending.bTraced = true;
+
+	const float LatencyMs = (FPlatformTime::Seconds() - Pending.QueueTime) * 1000.0;
+	AverageLatencyMs = FMath::Lerp(AverageLatencyMs, LatencyMs, 0.05f);
+
+	if (Data.OutHits.Num() > 0 && Data.OutHits[0].bBlockingHit)
+	{
+		Pending.Result.Hit = Data.OutHits[0];
+		Pending.Result.bBlockingHit = true;
+	}
+}
+
+//Shots are queued per weapon per frame, so each weapons shots are next to each other
+void USWeaponTraceSubsystem::ResolveInFlightShots()
+{
+	SCOPE_CYCLE_COUNTER(STAT_WeaponTraceResolve);
+
+	int32 Index = 0;
+	while (Index < InFlightShots.Num())
+	{
+		ASWeapon* Weapon = InFlightShots[Index].Weapon.Get();
+
+		ResolveBatch.Reset();
+		for (; Index < InFlightShots.Num() && InFlightShots[Index].Weapon.Get() == Weapon; Index++)
+		{
+			const FSPendingShot& Pending = InFlightShots[Index];
+			if (!Weapon)
+				continue;
+
+			//Dropped by the world
+			if (!Pending.bTraced)
+			{
+				INC_DWORD_STAT(STAT_WeaponTracesDropped);
+				continue;
+			}
+
+			ResolveBatch.Add(Pending.Result);
+		}
+
+		if (Weapon && ResolveBatch.Num() > 0)
+		{
+			Weapon->ResolveShots(ResolveBatch);
+		}
+	}
+}
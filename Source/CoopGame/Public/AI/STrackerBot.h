@@ -4,11 +4,12 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Pawn.h"
+#include "Subsystems/SGameplayTimerSubsystem.h"
 #include "STrackerBot.generated.h"
 
 class USHealthComponent;
-class USphereComponent;
 class USoundCue;
+struct FNavPathPoint;
 
 UCLASS()
 class COOPGAME_API ASTrackerBot : public APawn
@@ -19,15 +20,75 @@ public:
 	// Sets default values for this pawn's properties
 	ASTrackerBot();
 
-	// Called every frame
-	virtual void Tick(float DeltaTime) override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
-	virtual void NotifyActorBeginOverlap(AActor* OtherActor) override;
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+
+	virtual float TakeDamage(float DamageAmount, struct FDamageEvent const& DamageEvent, AController* EventInstigator, AActor* DamageCauser) override;
+
+	/* Point to steer towards this frame, refreshed from the flow field first */
+	FVector UpdateSteeringTarget(bool& bOutOnFlowField);
+
+	/* Reached the current path point, move on to the next */
+	void OnPathPointReached();
+
+	/* No progress towards the path point for a while. False if a repath is already on its way */
+	bool OnPathBlocked();
+
+	void DrawSteeringDebug(const FVector& SteeringPoint, const FVector& Force) const;
+
+	static bool IsDebugDrawingEnabled();
+
+	UStaticMeshComponent* GetMeshComp() const { return MeshComp; }
+
+	float GetMovementForce() const { return MovementForce; }
+
+	bool UsesVelocityChange() const { return bUseVelocityChange; }
+
+	float GetRequiredDistanceToTarget() const { return RequiredDistanceToTarget; }
+
+	float GetBlockedPathTime() const { return BlockedPathTime; }
+
+	float GetSelfDestructTriggerRadius() const { return SelfDestructTriggerRadius; }
+
+	uint8 GetTeamNum() const;
+
+	/* A hostile pawn came within the trigger radius, found by the tracker bot subsystems proximity pass. Returns true if that started self destruction. Server only */
+	bool OnHostileNearby(APawn* Hostile);
+
+	/* Put away in the game modes pool: hidden, no collision, not steered or targeted. Server only */
+	void EnterPool();
+
+	/* Taken out of the pool at SpawnTransform, reset to a freshly spawned bot. Server only */
+	void LeavePool(const FTransform& SpawnTransform);
+
+	bool IsInPool() const { return bInPool; }
+
+	/* Came from the game modes pool, goes back there instead of being destroyed */
+	void SetPooled(bool bNewPooled) { bPooled = bNewPooled; }
+
+	/* Set by the tracker bot subsystem when far from every player. Debug draws and the damage pulse are skipped */
+	void SetLowSignificance(bool bNewLowSignificance) { bLowSignificance = bNewLowSignificance; }
 
 protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
 
+	/* Start looking for targets and steering towards them */
+	void StartHunting();
+
+	void ReturnToPool();
+
+	/* Bumped each time the bot leaves the pool, clients reset their local explosion state */
+	UPROPERTY(ReplicatedUsing=OnRep_PoolGeneration)
+	uint8 PoolGeneration;
+
+	UFUNCTION()
+	void OnRep_PoolGeneration();
+
+	/* Clear explosion state on any machine */
+	void ResetExplosionState();
+
 	UFUNCTION()
 	void HandleTakeDamage(USHealthComponent* OwningHealthComp,
 		float Health, float HealthDelta, const class UDamageType* DamageType,
@@ -37,22 +98,52 @@ protected:
 
 	void DamageSelf();
 
+	/* Leave the tracker bot subsystem, stops all movement */
+	void StopSteering();
+
+	void ClearGameplayTimers();
+
 protected:
 
 	UPROPERTY(VisibleDefaultsOnly, Category = "Components")
 		UStaticMeshComponent* MeshComp;
 
-	UPROPERTY(VisibleDefaultsOnly, Category = "Components")
-		USphereComponent* SphereComp;
-
 	UPROPERTY(VisibleDefaultsOnly, Category = "Components")
 		USHealthComponent* HealthComp;
 
-	FVector GetNextPathPoint();
+	/* Ask for a new path to the nearest target, unless the current one still leads there */
+	void RepathIfNeeded();
+
+	void OnPathFound(bool bSuccess, const TArray<FNavPathPoint>& PathPoints);
+
+	/* Move on to the next point of the stored path, repath when it runs out */
+	void AdvancePath();
+
+	/* Steer from the path targets flow field. False when we are not on it, then the stored path is followed instead */
+	bool FollowFlowField();
 
 	//Next point in nav path
 	FVector NextPathPoint;
 
+	//Rest of the current path, NextPathPoint is PathPoints[PathIndex]
+	TArray<FVector, TInlineAllocator<16>> PathPoints;
+	int32 PathIndex;
+
+	// Who the current path leads to, and where they were when it was found
+	TWeakObjectPtr<AActor> PathTarget;
+	FVector PathTargetLocation;
+
+	// Waiting on a path request, keep steering to the last point until it arrives
+	bool bPathRequestPending;
+
+	/* Repath when the target moves this far from where it was when the path was found */
+	UPROPERTY(EditDefaultsOnly, Category = "TrackerBot")
+	float RepathDistance;
+
+	/* Repath when we stop getting closer to the next path point for this long */
+	UPROPERTY(EditDefaultsOnly, Category = "TrackerBot")
+	float BlockedPathTime;
+
 	UPROPERTY(EditDefaultsOnly, Category = "TrackerBot")
 	float MovementForce;
 
@@ -62,22 +153,35 @@ protected:
 	UPROPERTY(EditDefaultsOnly, Category = "TrackerBot")
 	float RequiredDistanceToTarget;
 
-	//Dynamic material to pulse on dmg
-	UMaterialInstanceDynamic* MatInst;
-
 	UPROPERTY(EditDefaultsOnly, Category = "TrackerBot")
 	UParticleSystem* ExplosionEffect;
 
 	bool bExploded;
+
+	UPROPERTY(ReplicatedUsing=OnRep_SelfDestructStarted)
 	bool bStartedSelfDestruction;
 
+	UFUNCTION()
+	void OnRep_SelfDestructStarted();
+
+	/* Hostile pawns this close start the self destruction sequence */
+	UPROPERTY(EditDefaultsOnly, Category = "TrackerBot")
+	float SelfDestructTriggerRadius;
+
+	bool bLowSignificance;
+
+	bool bPooled;
+	bool bInPool;
+
+	FSGameplayTimerHandle TimerHandle_ReturnToPool;
+
 	UPROPERTY(EditDefaultsOnly, Category = "TrackerBot")
 	float ExplosionRadius;
 
 	UPROPERTY(EditDefaultsOnly, Category = "TrackerBot")
 		float ExplosionDamage;
 
-	FTimerHandle TimerHandle_SelfDamage;
+	FSGameplayTimerHandle TimerHandle_SelfDamage;
 
 	UPROPERTY(EditDefaultsOnly, Category = "TrackerBot")
 	USoundCue* SelfDestructSound;
@@ -87,7 +191,7 @@ protected:
 
 	float SelfDamageInterval;
 
-	FTimerHandle TimerHandle_RefreshPath;
+	FSGameplayTimerHandle TimerHandle_RefreshPath;
 
 	void RefreshPath();
 };
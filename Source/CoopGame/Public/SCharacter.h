@@ -108,4 +108,6 @@ public:
 
 	virtual FVector GetPawnViewLocation() const override;
 
+	virtual void PossessedBy(AController* NewController) override;
+
 };
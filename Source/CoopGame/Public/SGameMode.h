@@ -8,6 +8,7 @@
 
 
 enum class EWaveState : uint8;
+class ASTrackerBot;
 
 
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_ThreeParams(FOnActorKilled, AActor*, VictimActor, AActor*, KillerActor, AController*, KillerController); //Killed actor, Killer actor
@@ -34,6 +35,52 @@ protected:
 	UPROPERTY(EditDefaultsOnly, Category = "GameMode")
 	float TimeBetweenWaves;
 
+	/* Bot class kept in the pool and handed out by SpawnTrackerBot */
+	UPROPERTY(EditDefaultsOnly, Category = "GameMode")
+	TSubclassOf<ASTrackerBot> TrackerBotClass;
+
+	/* Most idle bots kept around, extra bots returned are destroyed */
+	UPROPERTY(EditDefaultsOnly, Category = "GameMode")
+	int32 MaxPooledBots;
+
+	//Idle bots ready for reuse
+	UPROPERTY()
+	TArray<ASTrackerBot*> PooledBots;
+
+	/* Spawn idle bots until the pool holds Count, done between waves so the wave itself doesn't pay for spawning */
+	void PrewarmTrackerBots(int32 Count);
+
+	ASTrackerBot* SpawnPooledBot(const FTransform& SpawnTransform);
+
+	//Bots of the current wave that are out and alive, the wave is complete when this empties
+	TSet<TWeakObjectPtr<APawn>> LiveBots;
+
+	UFUNCTION()
+	void HandleActorKilled(AActor* VictimActor, AActor* KillerActor, AController* KillerController);
+
+	/* Count live bots the slow way, every pawn in the world, and complain if the live bot set disagrees */
+	void VerifyLiveBotCount() const;
+
+	//Pawns of players who are alive, and the player each belongs to. Dead pawns lose their controller before we hear of the death
+	TMap<TWeakObjectPtr<APawn>, TWeakObjectPtr<AController>> AlivePlayers;
+
+	//Players waiting for a restart
+	TSet<TWeakObjectPtr<AController>> DeadPlayers;
+
+	bool bGameOver;
+
+	/* Player Pawn is alive, replacing whatever pawn the player had before */
+	void SetPlayerAlive(AController* Player, APawn* PlayerPawn);
+
+	/* Players pawn died or went away. Game over when it was the last one alive */
+	void SetPlayerDead(APawn* PlayerPawn);
+
+	/* Push the alive and dead counts to the game state for HUDs */
+	void UpdatePlayerCounts();
+
+	UFUNCTION()
+	void HandlePlayerPawnDestroyed(AActor* DestroyedActor);
+
 protected:
 
 	// Hook for BP to spawn a single bot
@@ -53,8 +100,6 @@ protected:
 
 	void CheckWaveState();
 
-	void CheckAnyPlayerAlive();
-
 	void GameOver();
 
 	void RestartDeadPlayers();
@@ -68,9 +113,30 @@ public:
 
 	virtual void StartPlay() override;
 
-	virtual void Tick(float DeltaSeconds) override;
+	virtual void RestartPlayer(AController* NewPlayer) override;
+
+	virtual void Logout(AController* Exiting) override;
 
 	UPROPERTY(BlueprintAssignable, Category = "GameMode")
 	FOnActorKilled OnActorKilled;
 
+	/* Tracker bot at SpawnTransform, reused from the pool when one is idle. For the SpawnNewBot hook */
+	UFUNCTION(BlueprintCallable, Category = "GameMode")
+	ASTrackerBot* SpawnTrackerBot(const FTransform& SpawnTransform);
+
+	/* Exploded bot going back into the pool */
+	void ReleaseTrackerBot(ASTrackerBot* Bot);
+
+	/* Enemy came into play or out of the pool and counts towards the wave. Tracker bots register when they start hunting, AI characters when an AI possesses them */
+	void RegisterLiveBot(APawn* Bot);
+
+	/* Bot died or left play without dying. Completes the wave when it was the last one */
+	void UnregisterLiveBot(APawn* Bot);
+
+	int32 GetNumLiveBots() const { return LiveBots.Num(); }
+
+	int32 GetNumPlayersAlive() const { return AlivePlayers.Num(); }
+
+	int32 GetNumPlayersDead() const { return DeadPlayers.Num(); }
+
 };
@@ -42,9 +42,25 @@ protected:
 	UPROPERTY(BlueprintReadOnly, ReplicatedUsing = OnRep_WaveState, Category = "GameState")
 		EWaveState WaveState;
 
+	UFUNCTION()
+	void OnRep_PlayerCounts();
+
+	UFUNCTION(BlueprintImplementableEvent, Category = "GameState")
+	void PlayerCountsChanged(int32 PlayersAlive, int32 PlayersDead);
+
+	/* Players with a live pawn, kept up to date by the game mode */
+	UPROPERTY(BlueprintReadOnly, ReplicatedUsing = OnRep_PlayerCounts, Category = "GameState")
+	uint8 NumPlayersAlive;
+
+	/* Players waiting to be restarted */
+	UPROPERTY(BlueprintReadOnly, ReplicatedUsing = OnRep_PlayerCounts, Category = "GameState")
+	uint8 NumPlayersDead;
+
 public:
 
 	
 	void SetWaveState(EWaveState NewState);
 
+	void SetPlayerCounts(int32 Alive, int32 Dead);
+
 };
@@ -4,6 +4,7 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
+#include "Subsystems/SGameplayTimerSubsystem.h"
 #include "SPickupActor.generated.h"
 
 class USphereComponent;
@@ -38,7 +39,7 @@ protected:
 	UPROPERTY(EditInstanceOnly, Category = "PickupActor")
 	float CooldownDuration;
 
-	FTimerHandle TimerHandle_RespawnTimer;
+	FSGameplayTimerHandle TimerHandle_RespawnTimer;
 
 	void Respawn();
 
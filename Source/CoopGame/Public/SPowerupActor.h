@@ -4,6 +4,7 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
+#include "Subsystems/SGameplayTimerSubsystem.h"
 #include "SPowerupActor.generated.h"
 
 UCLASS()
@@ -27,7 +28,7 @@ protected:
 
 	int32 TicksProcessed;
 
-	FTimerHandle TimerHandle_PowerupTick;
+	FSGameplayTimerHandle TimerHandle_PowerupTick;
 
 	UFUNCTION()
 		void OnTickPowerup();
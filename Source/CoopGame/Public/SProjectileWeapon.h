@@ -4,6 +4,7 @@
 
 #include "CoreMinimal.h"
 #include "SWeapon.h"
+#include "Subsystems/SProjectileSubsystem.h"
 #include "SProjectileWeapon.generated.h"
 
 class ASProjectile;
@@ -12,6 +13,18 @@ UCLASS()
 class COOPGAME_API ASProjectileWeapon : public ASWeapon
 {
 	GENERATED_BODY()
+
+public:
+
+	const FSProjectileParams& GetProjectileParams() const { return ProjectileParams; }
+
+	float GetProjectileDamage() const { return DamageAmount; }
+
+	TSubclassOf<UDamageType> GetDamageType() const { return DamageType; }
+
+	TSubclassOf<AActor> GetProjectileClass() const { return ProjectileClass; }
+
+	TSubclassOf<AActor> GetProjectileVisualClass() const { return ProjectileVisualClass; }
 	
 protected:
 
@@ -20,7 +33,30 @@ protected:
 
 	virtual void Fire() override;
 
+	virtual void FireBatch(int32 NumShots, float OldestShotAge) override;
+
+	/* Launch one projectile, already FastForward seconds into its flight */
+	void FireProjectile(float FastForward);
+
+	/* Tell clients to simulate a cosmetic copy of a server projectile. The owning client reconciles its predicted one instead */
+	UFUNCTION(NetMulticast, Unreliable)
+	void MulticastLaunchProjectile(FVector_NetQuantize Location, FVector_NetQuantize Velocity, uint16 PredictionId);
+
+	/* Matches a predicted projectile on the owning client with the servers one. Same on both, as both count shots from the same seed */
+	uint16 GetPredictionId() const;
+
+	/* Half the owners round trip time, in seconds. Zero for locally controlled owners */
+	float GetOwnerHalfRoundTrip() const;
+
+	/* Actor spawned per shot when the projectile subsystem is disabled */
 	UPROPERTY(EditDefaultsOnly, Category = "ProjectileWeapon")
 	TSubclassOf<AActor> ProjectileClass;
 
+	/* Shown for projectiles simulated by the projectile subsystem. Purely visual, no collision, movement or gameplay logic of its own */
+	UPROPERTY(EditDefaultsOnly, Category = "ProjectileWeapon")
+	TSubclassOf<AActor> ProjectileVisualClass;
+
+	UPROPERTY(EditDefaultsOnly, Category = "ProjectileWeapon")
+	FSProjectileParams ProjectileParams;
+
 };
@@ -11,19 +11,138 @@ class USkeletalMeshComponent;
 class UDamageType;
 class UParticleSystem;
 class UCameraShakeBase;
+struct FSWeaponShot;
+struct FSWeaponShotResult;
+
+//Number of recent shots kept for replication. Power of two so the 8 bit shot counter wraps cleanly
+#define HITSCAN_HISTORY_SIZE 8
 
 //Contains info of a single hitscan weapon linetrace
+struct FHitScanShot
+{
+	FVector TraceTo;
+
+	TEnumAsByte<EPhysicalSurface> SurfaceType;
+};
+
+//Recent hitscan shots, so remote clients can replay every shot fired between net updates
 USTRUCT()
 struct FHitScanTrace
 {
 	GENERATED_BODY()
 
 public:
-	UPROPERTY()
-	TEnumAsByte<EPhysicalSurface> SurfaceType;
 
-	UPROPERTY()
-	FVector_NetQuantize TraceTo;
+	FHitScanTrace();
+
+	// Total shots fired, wraps. Clients compare it to the last one they played
+	uint8 ShotCounter;
+
+	// Shots sent in the current net update, the newest ones in the buffer
+	uint8 NumShots;
+
+	// Shots fired since the last net update (server only)
+	uint8 NumPendingShots;
+
+	// Muzzle location of the newest shot. Endpoints are sent relative to it
+	FVector Origin;
+
+	FHitScanShot Shots[HITSCAN_HISTORY_SIZE];
+
+	void AddShot(const FVector& MuzzleLocation, const FVector& TraceTo, EPhysicalSurface SurfaceType);
+
+	/* Called before each net update, the shots fired since the last one are the ones sent */
+	void PrepareNetUpdate();
+
+	/* Index of the sent shots, 0 is the oldest */
+	const FHitScanShot& GetSentShot(int32 Index) const { return Shots[GetSentShotSlot(Index)]; }
+
+	int32 GetSentShotSlot(int32 Index) const { return (uint8)(ShotCounter - NumShots + Index) % HITSCAN_HISTORY_SIZE; }
+
+	bool NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess);
+
+	//Only a new shot needs replicating
+	bool operator==(const FHitScanTrace& Other) const { return ShotCounter == Other.ShotCounter; }
+};
+
+template<>
+struct TStructOpsTypeTraits<FHitScanTrace> : public TStructOpsTypeTraitsBase2<FHitScanTrace>
+{
+	enum
+	{
+		WithNetSerializer = true,
+		WithIdenticalViaEquality = true,
+	};
+};
+
+//Pellet patterns kept for replication. Power of two so the 8 bit pattern counter wraps cleanly
+#define PELLET_HISTORY_SIZE 4
+
+//Most pellets per shot, one bit each in the hit mask
+#define MAX_PELLETS 16
+
+//A whole pellet pattern. Clients regenerate the pellet directions from the seed
+struct FPelletPattern
+{
+	// Where the pellets were traced from
+	FVector Origin;
+
+	// Center of the pattern
+	FVector AimDirection;
+
+	int32 Seed;
+
+	// Bit per pellet, set if it hit something
+	uint16 HitMask;
+
+	uint8 NumPellets;
+};
+
+//Recent pellet patterns, so remote clients can replay every pattern fired between net updates
+USTRUCT()
+struct FPelletTrace
+{
+	GENERATED_BODY()
+
+public:
+
+	FPelletTrace();
+
+	// Total patterns fired, wraps
+	uint8 PatternCounter;
+
+	// Patterns sent in the current net update, the newest ones in the buffer
+	uint8 NumPatterns;
+
+	// Patterns fired since the last net update (server only)
+	uint8 NumPendingPatterns;
+
+	FPelletPattern Patterns[PELLET_HISTORY_SIZE];
+
+	void AddPattern(const FPelletPattern& Pattern);
+
+	/* Called before each net update, the patterns fired since the last one are the ones sent */
+	void PrepareNetUpdate();
+
+	/* Index of the sent patterns, 0 is the oldest */
+	const FPelletPattern& GetSentPattern(int32 Index) const { return Patterns[GetSentPatternSlot(Index)]; }
+
+	int32 GetSentPatternSlot(int32 Index) const { return (uint8)(PatternCounter - NumPatterns + Index) % PELLET_HISTORY_SIZE; }
+
+	bool NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess);
+
+	//Only a new pattern needs replicating
+	bool operator==(const FPelletTrace& Other) const { return PatternCounter == Other.PatternCounter; }
+};
+
+template<>
+struct TStructOpsTypeTraits<FPelletTrace> : public TStructOpsTypeTraitsBase2<FPelletTrace>
+{
+	enum
+	{
+		WithNetSerializer = true,
+		WithIdenticalViaEquality = true,
+	};
 };
 
 
@@ -41,6 +160,17 @@ public:
 	// Sets default values for this actor's properties
 	ASWeapon();
 
+	virtual void Tick(float DeltaTime) override;
+
+	/* Trace shots right away and resolve them */
+	void TraceShots(TArrayView<const FSWeaponShot> Shots);
+
+	/* Apply damage and effects for a batch of traced shots. Damage is summed per hit actor */
+	void ResolveShots(TArrayView<const FSWeaponShotResult> Results);
+
+	/* Weapon trace params, rebuilt only when the owner changes */
+	const FCollisionQueryParams& GetTraceQueryParams();
+
 
 protected:
 
@@ -76,8 +206,9 @@ protected:
 
 
 		//Fire rate vars
-	FTimerHandle TimeHandle_TimeBetweenShots;
 	float LastFireTime;
+	/* Time owed towards the next shot while the trigger is held. Carries the remainder between frames */
+	float FireAccumulator;
 	/* RPM - Bullets per minute fired by weapon */
 	UPROPERTY(EditDefaultsOnly, Category = "Weapon")
 	float RateOfFire;
@@ -88,24 +219,94 @@ protected:
 	UPROPERTY(EditDefaultsOnly, Category = "Weapon", meta=(ClampMin=0.0f))
 	float BulletSpread;
 
+	/* Traces per shot. More than one fires a pellet pattern (shotguns, flak) */
+	UPROPERTY(EditDefaultsOnly, Category = "Weapon", meta=(ClampMin=1, ClampMax=16))
+	int32 PelletsPerShot;
+
+	/* Pellet spread around the shot direction in degrees */
+	UPROPERTY(EditDefaultsOnly, Category = "Weapon", meta=(ClampMin=0.0f))
+	float PelletSpread;
+
 	//replicate using a given function
 	UPROPERTY(ReplicatedUsing=OnRep_HitScanTrace)
 	FHitScanTrace HitScanTrace;
 
+	// ShotCounter of the last replicated shot we played effects for
+	uint8 LastPlayedShotCounter;
+
+	//Pellet patterns, replicated as seed + hit mask instead of a hitscan trace per pellet
+	UPROPERTY(ReplicatedUsing=OnRep_PelletTrace)
+	FPelletTrace PelletTrace;
+
+	// PatternCounter of the last replicated pattern we played effects for
+	uint8 LastPlayedPatternCounter;
+
+	FCollisionQueryParams TraceQueryParams;
+
+	// Owner the cached TraceQueryParams were built for
+	TWeakObjectPtr<AActor> TraceQueryParamsOwner;
+
+	/* Server time the client fired the shot being processed. Negative when the shot is not lag compensated */
+	float LagCompensationTimestamp;
+
+	/* Seeded per burst so the server can regenerate the same spread as the client */
+	FRandomStream SpreadStream;
+
+	/* Shots fired since the last StartFire */
+	int32 BurstShotCount;
+
+	/* Server time the clients current burst started. Only valid on the server during a remote burst */
+	float BurstStartTimestamp;
+
+	/* Server is firing on behalf of a remote client */
+	bool bRemoteBurst;
+
 protected:
 
 	//Replicated function
 	UFUNCTION()
 		void OnRep_HitScanTrace();
 
+	UFUNCTION()
+		void OnRep_PelletTrace();
+
 	virtual void BeginPlay() override;
 
+	virtual void PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker) override;
+
 	virtual void Fire();
 
+	/* Fire NumShots at once, spaced TimeBetweenShots apart. The oldest was due OldestShotAge seconds ago */
+	virtual void FireBatch(int32 NumShots, float OldestShotAge);
+
+	void ConsumeFireAccumulator();
+
+	/* Start the fire accumulator, the first shot comes after Delay */
+	void BeginFiring(float Delay);
+
+	void EndFiring();
+
 	UFUNCTION(Server, Reliable, WithValidation) //Server - will push request to hosting server, Reliable - Guarenteed to get to server, WithValidation - 
-		void ServerFire();
+		void ServerFire(float FireTimestamp);
+
+	/* Fire state mode, the client only sends trigger transitions */
+	UFUNCTION(Server, Reliable, WithValidation)
+		void ServerStartFire(int32 SpreadSeed, float StartTimestamp);
+
+	UFUNCTION(Server, Reliable, WithValidation)
+		void ServerStopFire(int32 ClientShotCount);
+
+	float GetServerWorldTime() const;
+
+	/* Clients only send trigger transitions (COOP.WeaponFireStateMode) */
+	static bool UseFireStateReplication();
+
+	/* Next pellet direction of a pattern. Same sequence everywhere for the same seed */
+	FVector GetPelletDirection(FRandomStream& PelletStream, const FVector& AimDirection) const;
+
+	void PlayFireEffects(FVector TracerEndPoint, bool bMuzzleFlash = true);
 
-	void PlayFireEffects(FVector TracerEndPoint);
+	void PlayFireCameraShake();
 
 	void PlayImpactEffects(EPhysicalSurface SurfaceType, FVector ImpactPoint);
 
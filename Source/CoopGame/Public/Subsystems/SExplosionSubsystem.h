@@ -0,0 +1,97 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/STickableWorldSubsystem.h"
+#include "WorldCollision.h"
+#include "SExplosionSubsystem.generated.h"
+
+class UDamageType;
+
+//An explosion waiting to be resolved
+struct FSExplosion
+{
+	TWeakObjectPtr<AActor> Causer;
+
+	TWeakObjectPtr<AController> Instigator;
+
+	FVector Origin;
+
+	float BaseDamage;
+
+	float Radius;
+
+	TSubclassOf<UDamageType> DamageType;
+
+	// Full damage everywhere in the radius, otherwise linear falloff to the edge
+	bool bFullDamage;
+};
+
+//Damage one victim takes from all explosions resolved this frame
+struct FSExplosionVictim
+{
+	TWeakObjectPtr<AActor> Victim;
+
+	float Damage;
+
+	// The explosion that did the most damage is reported as the source
+	int32 StrongestExplosion;
+	float StrongestDamage;
+
+	FSExplosionVictim()
+		: Damage(0.0f)
+		, StrongestExplosion(INDEX_NONE)
+		, StrongestDamage(0.0f)
+	{
+	}
+};
+
+/**
+ * Resolves radial damage for explosions on the server in batches, instead of each explosion running its own overlap and traces.
+ * Explosions queue up during the frame. Each frame a limited number are resolved together: victims come from the target index,
+ * line of sight traces are shared between explosions at nearly the same spot, and each victim takes one summed hit.
+ * Explosions caused by that damage wait for the next frame, so chain reactions spread over several frames.
+ * Only pawns take damage. Other simulating bodies in range are pushed without damage.
+ */
+UCLASS()
+class COOPGAME_API USExplosionSubsystem : public USTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	virtual void Tick(float DeltaTime) override;
+
+	virtual bool IsTickable() const override;
+
+	virtual TStatId GetStatId() const override;
+
+	/* Damage everything in Radius around Origin that Causer can see. Resolved at the end of the frame, or later when over budget */
+	void QueueExplosion(AActor* Causer, AController* Instigator, const FVector& Origin, float BaseDamage, float Radius, TSubclassOf<UDamageType> DamageType, bool bFullDamage);
+
+	int32 GetNumQueued() const { return QueuedExplosions.Num(); }
+
+protected:
+
+	/* Line of sight from Origin to Victim, shared with every explosion in the same small cell this frame */
+	bool CanDamage(const FSExplosion& Explosion, AActor* Victim);
+
+	/* Push simulating bodies that aren't pawns, like radial damage would. Pawns get their push from the damage itself */
+	void PushPhysicsBodies(const FSExplosion& Explosion);
+
+	TArray<FSExplosion> QueuedExplosions;
+
+	// Scratch, kept between frames to avoid allocations
+	TArray<FSExplosion> ResolvingExplosions;
+
+	TArray<FSExplosionVictim> Victims;
+
+	TMap<AActor*, int32> VictimIndices;
+
+	TMap<TPair<FIntVector, AActor*>, bool> VisibilityCache;
+
+	TArray<APawn*> Candidates;
+
+	TArray<FOverlapResult> Overlaps;
+};
@@ -0,0 +1,109 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/STickableWorldSubsystem.h"
+#include "Async/Future.h"
+#include "SFlowFieldSubsystem.generated.h"
+
+class ANavigationData;
+
+//Walkable navmesh cells on a flat grid. Built once, then only read, by every field build
+struct FSFlowGrid
+{
+	// Min corner of the grid
+	FVector Origin;
+
+	float CellSize;
+
+	int32 SizeX;
+	int32 SizeY;
+
+	// Navmesh height per cell
+	TArray<float> Heights;
+
+	TArray<bool> Walkable;
+
+	int32 GetIndex(const FIntPoint& Cell) const { return Cell.Y * SizeX + Cell.X; }
+
+	bool IsInside(const FIntPoint& Cell) const { return Cell.X >= 0 && Cell.Y >= 0 && Cell.X < SizeX && Cell.Y < SizeY; }
+
+	bool WorldToCell(const FVector& Location, FIntPoint& OutCell) const;
+
+	FVector CellToWorld(const FIntPoint& Cell) const;
+
+	/* Can a bot move from one cell to its neighbour. Blocked by unwalkable cells and steep height changes */
+	bool CanStep(int32 FromIndex, int32 ToIndex) const;
+};
+
+//Direction to move in from every cell to reach one target
+struct FSFlowFieldData
+{
+	FIntPoint TargetCell;
+
+	// Per cell, index into the neighbour offsets, or one of the special values
+	TArray<uint8> Directions;
+};
+
+typedef TSharedPtr<const FSFlowFieldData, ESPMode::ThreadSafe> FSFlowFieldDataPtr;
+
+//A targets field. The current one is used while the next one builds on a worker thread
+struct FSFlowField
+{
+	TWeakObjectPtr<AActor> Target;
+
+	FSFlowFieldDataPtr Current;
+
+	TFuture<FSFlowFieldDataPtr> Pending;
+
+	// Target cell the newest field (built or building) leads to
+	FIntPoint BuildCell;
+
+	// Fields nobody samples are dropped
+	float LastSampleTime;
+};
+
+/**
+ * Flow fields over the navmesh, one per bot target.
+ * Each field stores the direction to move in from every navmesh cell to reach its target, so any number of bots
+ * chasing the same player steer from one lookup instead of each running their own path query.
+ * Fields are built on worker threads and rebuilt when their target moves a few cells.
+ * The grid is a single layer, bots outside it or on unreachable cells fall back to path requests.
+ */
+UCLASS()
+class COOPGAME_API USFlowFieldSubsystem : public USTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	virtual void Tick(float DeltaTime) override;
+
+	virtual bool IsTickable() const override;
+
+	virtual TStatId GetStatId() const override;
+
+	bool IsEnabled() const;
+
+	/* Where a bot at Location should move to next to reach Target. Starts building a field for Target if it has none. False if there is no field (yet) for Location */
+	bool SampleFlow(AActor* Target, const FVector& Location, FVector& OutMoveTo);
+
+	/* Build the walkable grid now if it hasn't been. False if there is no navmesh */
+	bool EnsureGrid();
+
+	/* Field from every cell to TargetCell, up to MaxDistance cells away. Thread safe */
+	static FSFlowFieldDataPtr BuildField(const FSFlowGrid& Grid, const FIntPoint& TargetCell, int32 MaxDistance);
+
+	const FSFlowGrid* GetGrid() const { return Grid.Get(); }
+
+protected:
+
+	static TSharedPtr<FSFlowGrid, ESPMode::ThreadSafe> BuildGrid(const ANavigationData& NavData, const FBox& Bounds, float CellSize);
+
+	TSharedPtr<FSFlowGrid, ESPMode::ThreadSafe> Grid;
+
+	TArray<FSFlowField> Fields;
+
+	float NextGridAttemptTime;
+};
@@ -0,0 +1,158 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/STickableWorldSubsystem.h"
+#include "SGameplayTimerSubsystem.generated.h"
+
+//What a gameplay timer is for, active timers are counted per category
+enum class ESGameplayTimerCategory : uint8
+{
+	BotPath,
+	BotSelfDamage,
+	BotPool,
+	Powerup,
+	PickupRespawn,
+
+	Num
+};
+
+//Refers to one scheduled gameplay timer. Goes stale by itself once the timer is cleared or has fired
+struct FSGameplayTimerHandle
+{
+	int32 Index;
+
+	uint32 Serial;
+
+	FSGameplayTimerHandle()
+		: Index(INDEX_NONE)
+		, Serial(0)
+	{
+	}
+
+	bool IsValid() const { return Index != INDEX_NONE; }
+
+	void Invalidate() { Index = INDEX_NONE; }
+};
+
+//Calls a member function on the timers target, one instance per callback so no delegate is bound
+typedef void (*FSGameplayTimerCallback)(UObject* Target);
+
+struct FSGameplayTimer
+{
+	TWeakObjectPtr<UObject> Target;
+
+	FSGameplayTimerCallback Callback;
+
+	float Interval;
+
+	// Exact time the timer is due, DueTick is this rounded up to the wheel resolution
+	float DueTime;
+
+	int64 DueTick;
+
+	// Bumped every time the slot is freed, so old handles stop matching
+	uint32 Serial;
+
+	// Bucket the timer is linked into, INDEX_NONE while taken out to fire
+	int32 Bucket;
+
+	// Links in the bucket list, or the free list
+	int32 Prev;
+	int32 Next;
+
+	ESGameplayTimerCategory Category;
+
+	bool bLoop;
+
+	bool bActive;
+
+	FSGameplayTimer()
+		: Callback(nullptr)
+		, Interval(0.0f)
+		, DueTime(0.0f)
+		, DueTick(0)
+		, Serial(1)
+		, Bucket(INDEX_NONE)
+		, Prev(INDEX_NONE)
+		, Next(INDEX_NONE)
+		, Category(ESGameplayTimerCategory::Num)
+		, bLoop(false)
+		, bActive(false)
+	{
+	}
+};
+
+/**
+ * Timing wheel for the small per actor gameplay timers, instead of each one going through the world timer manager.
+ * Timers live in one pooled array and hang off one of a fixed number of buckets by the tick they are due,
+ * so setting and clearing a timer is a few index swaps. Each frame only the buckets for the elapsed ticks are walked,
+ * their due timers are taken out together and then fired.
+ * Callbacks are plain member functions picked at compile time, targets are held weakly and their timers dropped when they go away.
+ */
+UCLASS()
+class COOPGAME_API USGameplayTimerSubsystem : public USTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+
+	virtual void Deinitialize() override;
+
+	virtual void Tick(float DeltaTime) override;
+
+	virtual TStatId GetStatId() const override;
+
+	/* Call Target->Func after Delay, then every Delay when looping. FirstDelay >= 0 overrides the first wait. Replaces whatever Handle was set to */
+	template<typename T, void (T::*Func)()>
+	void SetTimer(FSGameplayTimerHandle& Handle, T* Target, float Delay, bool bLoop, ESGameplayTimerCategory Category, float FirstDelay = -1.0f)
+	{
+		SetTimerInternal(Handle, Target, &CallMember<T, Func>, Delay, bLoop, Category, FirstDelay);
+	}
+
+	void ClearTimer(FSGameplayTimerHandle& Handle);
+
+	bool IsTimerActive(const FSGameplayTimerHandle& Handle) const;
+
+	int32 GetNumActiveTimers(ESGameplayTimerCategory Category) const { return ActiveCounts[(uint8)Category]; }
+
+protected:
+
+	template<typename T, void (T::*Func)()>
+	static void CallMember(UObject* Target)
+	{
+		(static_cast<T*>(Target)->*Func)();
+	}
+
+	void SetTimerInternal(FSGameplayTimerHandle& Handle, UObject* Target, FSGameplayTimerCallback Callback, float Delay, bool bLoop, ESGameplayTimerCategory Category, float FirstDelay);
+
+	/* Index of the live timer Handle refers to, or INDEX_NONE */
+	int32 FindTimer(const FSGameplayTimerHandle& Handle) const;
+
+	/* Put the timer in the bucket for its DueTime */
+	void Schedule(int32 Index);
+
+	void Unlink(int32 Index);
+
+	void FreeTimer(int32 Index);
+
+	TArray<FSGameplayTimer> Timers;
+
+	int32 FirstFree;
+
+	// First timer of each bucket, buckets are indexed by tick modulo their count
+	TArray<int32> Buckets;
+
+	// Scratch, timers taken out of the buckets this frame and the serials they had
+	TArray<TPair<int32, uint32>> Firing;
+
+	int32 ActiveCounts[(uint8)ESGameplayTimerCategory::Num];
+
+	float Now;
+
+	// Every tick up to and including this one has been fired
+	int64 LastTick;
+};
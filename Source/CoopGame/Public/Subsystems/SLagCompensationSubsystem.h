@@ -0,0 +1,114 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/STickableWorldSubsystem.h"
+#include "SLagCompensationSubsystem.generated.h"
+
+class APawn;
+class UPrimitiveComponent;
+struct FBodyInstance;
+
+//Number of transforms kept per pawn. One is recorded every server frame
+#define LAGCOMPENSATION_HISTORY_SIZE 32
+
+//A single recorded hitbox transform
+struct FSLagCompensationSample
+{
+	FQuat Rotation;
+	FVector Location;
+	float Time;
+};
+
+//Fixed size ring buffer of a pawns recent hitbox transforms
+struct FSLagCompensationHistory
+{
+	TWeakObjectPtr<APawn> Pawn;
+
+	// Component the weapon trace actually hits
+	TWeakObjectPtr<UPrimitiveComponent> HitBox;
+
+	// Radius around the component origin that contains the hitbox
+	float ReachRadius;
+
+	// Index of the newest sample
+	int32 Head;
+
+	int32 NumSamples;
+
+	FSLagCompensationSample Samples[LAGCOMPENSATION_HISTORY_SIZE];
+
+	void Record(const FTransform& Transform, float Time);
+
+	/* Interpolated transform at Time. False if Time is newer than the latest sample (nothing to rewind) */
+	bool GetTransformAtTime(float Time, FTransform& OutTransform) const;
+};
+
+/**
+ * Server side lag compensation for hitscan weapons.
+ * Records the hitbox transform of every pawn with a health component each frame,
+ * and can move them back to where a client saw them when it fired.
+ */
+UCLASS()
+class COOPGAME_API USLagCompensationSubsystem : public USTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+
+	virtual void Tick(float DeltaTime) override;
+
+	virtual bool IsTickable() const override;
+
+	virtual TStatId GetStatId() const override;
+
+	void RegisterPawn(APawn* Pawn);
+
+	void UnregisterPawn(APawn* Pawn);
+
+	/* Move pawns whose hitbox could intersect the trace back to their transform at Timestamp. Must be followed by Restore() */
+	void Rewind(float Timestamp, const FVector& TraceStart, const FVector& TraceEnd);
+
+	/* Put rewound pawns back where they are on the server */
+	void Restore();
+
+	bool IsEnabled() const;
+
+	/* Average cost of a rewind + restore in milliseconds, over the recent shots */
+	float GetAverageRewindCostMs() const { return AverageRewindCostMs; }
+
+protected:
+
+	//A physics body moved by a rewind, with the transform to restore
+	struct FSRewoundBody
+	{
+		FBodyInstance* Body;
+		FTransform OriginalTransform;
+	};
+
+	int32 FindHistoryIndex(const APawn* Pawn) const;
+
+	static UPrimitiveComponent* FindHitBox(APawn* Pawn);
+
+	TArray<FSLagCompensationHistory> Histories;
+
+	// Scratch buffer, reused for every shot
+	TArray<FSRewoundBody> RewoundBodies;
+
+	double RewindStartTime;
+
+	float AverageRewindCostMs;
+};
+
+//Rewinds pawns for the lifetime of the scope. Does nothing if Timestamp is negative
+struct COOPGAME_API FSLagCompensationScope
+{
+	FSLagCompensationScope(UWorld* World, float Timestamp, const FVector& TraceStart, const FVector& TraceEnd);
+	~FSLagCompensationScope();
+
+private:
+	USLagCompensationSubsystem* LagCompensation;
+};
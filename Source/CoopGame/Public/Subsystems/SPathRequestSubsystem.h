@@ -0,0 +1,78 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/STickableWorldSubsystem.h"
+#include "NavigationData.h"
+#include "SPathRequestSubsystem.generated.h"
+
+// Path points from the requesters start to the goal. Empty when no path was found
+DECLARE_DELEGATE_TwoParams(FSPathFoundDelegate, bool /*bSuccess*/, const TArray<FNavPathPoint>& /*PathPoints*/);
+
+//A path request waiting for, or part of, a nav query
+struct FSPathRequest
+{
+	TWeakObjectPtr<AActor> Requester;
+
+	TWeakObjectPtr<AActor> Goal;
+
+	FVector Start;
+
+	// Nav poly under Start, requests to the same goal from the same poly share a query
+	NavNodeRef StartPoly;
+
+	FSPathFoundDelegate Callback;
+
+	double QueueTime;
+};
+
+//One async nav query answering one or more requests
+struct FSPathQuery
+{
+	TArray<FSPathRequest, TInlineAllocator<4>> Requests;
+
+	double IssueTime;
+};
+
+/**
+ * Runs pathfinding for bots off the game thread through the navigation systems async queries.
+ * Requests queue up during the frame and are sent at the end of it, a limited number per frame.
+ * Requests heading to the same goal from the same or a nearby nav poly are merged into one query.
+ * Results come back through each requests callback, with the path starting at that requesters own start.
+ */
+UCLASS()
+class COOPGAME_API USPathRequestSubsystem : public USTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	virtual void Tick(float DeltaTime) override;
+
+	virtual bool IsTickable() const override;
+
+	virtual TStatId GetStatId() const override;
+
+	/* Queue a path from Start to Goal. Replaces any request from Requester still waiting in the queue */
+	void RequestPath(AActor* Requester, const FVector& Start, AActor* Goal, const FSPathFoundDelegate& Callback);
+
+	int32 GetQueueDepth() const { return QueuedRequests.Num(); }
+
+	int32 GetNumInFlight() const { return InFlightQueries.Num(); }
+
+	float GetAverageLatencyMs() const { return AverageLatencyMs; }
+
+protected:
+
+	void OnQueryFinished(uint32 QueryId, ENavigationQueryResult::Type Result, FNavPathSharedPtr Path);
+
+	TArray<FSPathRequest> QueuedRequests;
+
+	TMap<uint32, FSPathQuery> InFlightQueries;
+
+	// Scratch for building each requesters path
+	TArray<FNavPathPoint> ResultPoints;
+
+	float AverageLatencyMs;
+};
@@ -0,0 +1,172 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/STickableWorldSubsystem.h"
+#include "SProjectileSubsystem.generated.h"
+
+class ASProjectileWeapon;
+class UDamageType;
+class UParticleSystem;
+
+//How a weapons projectiles fly and explode
+USTRUCT(BlueprintType)
+struct FSProjectileParams
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Projectile")
+	float LaunchSpeed;
+
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Projectile")
+	float GravityScale;
+
+	/* Seconds before the projectile explodes */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Projectile")
+	float Lifetime;
+
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Projectile")
+	float CollisionRadius;
+
+	/* Fraction of velocity kept along the normal when bouncing */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Projectile", meta=(ClampMin=0.0f, ClampMax=1.0f))
+	float Bounciness;
+
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Projectile")
+	bool bExplodeOnPawnImpact;
+
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Projectile")
+	float ExplosionRadius;
+
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Projectile")
+	UParticleSystem* ExplosionEffect;
+
+	FSProjectileParams()
+		: LaunchSpeed(2000.0f)
+		, GravityScale(1.0f)
+		, Lifetime(1.0f)
+		, CollisionRadius(10.0f)
+		, Bounciness(0.3f)
+		, bExplodeOnPawnImpact(false)
+		, ExplosionRadius(250.0f)
+		, ExplosionEffect(nullptr)
+	{
+	}
+};
+
+//Everything shared by the projectiles of one weapon class
+USTRUCT()
+struct FSProjectileType
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	FSProjectileParams Params;
+
+	float Damage;
+
+	UPROPERTY()
+	TSubclassOf<UDamageType> DamageType;
+
+	/* Actor shown for the projectile on clients. Never simulated itself */
+	UPROPERTY()
+	TSubclassOf<AActor> VisualClass;
+
+	FSProjectileType()
+		: Damage(0.0f)
+	{
+	}
+};
+
+//Hidden visual actors ready for reuse
+USTRUCT()
+struct FSProjectileVisualPool
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	TArray<AActor*> Actors;
+};
+
+/**
+ * Simulates weapon projectiles as plain data instead of actors.
+ * Live projectiles are kept in parallel arrays and swept in one pass each frame.
+ * The server owns the real projectiles and applies damage. Clients simulate cosmetic copies,
+ * and any world that renders shows them with pooled actors.
+ */
+UCLASS()
+class COOPGAME_API USProjectileSubsystem : public USTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+
+	virtual void Deinitialize() override;
+
+	virtual void Tick(float DeltaTime) override;
+
+	virtual TStatId GetStatId() const override;
+
+	bool IsEnabled() const;
+
+	/* Start a projectile for Weapon. Cosmetic projectiles only show visuals and effects. FastForward is simulated right away.
+	 * A client predicting its own shot passes a PredictionId, so the projectile can be matched with the servers one later */
+	void LaunchProjectile(ASProjectileWeapon* Weapon, const FVector& Location, const FVector& Velocity, bool bCosmetic, float FastForward = 0.0f, int32 PredictionId = INDEX_NONE);
+
+	/* Move a predicted projectile onto the servers path, the visual blends over. False if no predicted projectile matches */
+	bool ReconcileProjectile(ASProjectileWeapon* Weapon, int32 PredictionId, const FVector& Location, const FVector& Velocity, float FastForward);
+
+	int32 GetNumProjectiles() const { return Positions.Num(); }
+
+	/* Cost of the last frames simulation in milliseconds */
+	float GetLastSimulationMs() const { return LastSimulationMs; }
+
+protected:
+
+	int32 FindOrAddType(ASProjectileWeapon* Weapon);
+
+	/* Step one projectile. Returns false when it exploded */
+	bool SimulateProjectile(int32 Index, float DeltaTime);
+
+	void Explode(int32 Index, const FVector& Location);
+
+	void RemoveProjectile(int32 Index);
+
+	AActor* AcquireVisual(TSubclassOf<AActor> VisualClass, const FVector& Location, const FRotator& Rotation);
+
+	void ReleaseVisual(AActor* Visual);
+
+	UPROPERTY()
+	TArray<FSProjectileType> Types;
+
+	TMap<UClass*, int32> TypeIndices;
+
+	//Live projectiles, one entry per projectile in each array
+	TArray<FVector> Positions;
+	TArray<FVector> Velocities;
+	TArray<float> Lifetimes;
+	// One type per weapon class, far more than a game will ever register
+	TArray<uint16> TypeIds;
+	TArray<bool> Cosmetic;
+	TArray<TWeakObjectPtr<ASProjectileWeapon>> Owners;
+	// Pawn holding the weapon at launch and its controller, the explosion still has someone to blame when the weapon is gone
+	TArray<TWeakObjectPtr<AActor>> DamageCausers;
+	TArray<TWeakObjectPtr<AController>> DamageInstigators;
+	TArray<int32> PredictionIds;
+	// Where the visual is drawn relative to the simulated position, decays to zero after a correction
+	TArray<FVector> VisualOffsets;
+
+	UPROPERTY()
+	TArray<AActor*> Visuals;
+
+	UPROPERTY()
+	TMap<UClass*, FSProjectileVisualPool> VisualPools;
+
+	/* False on dedicated servers */
+	bool bShowVisuals;
+
+	float LastSimulationMs;
+};
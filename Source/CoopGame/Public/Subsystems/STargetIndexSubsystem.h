@@ -0,0 +1,82 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/STickableWorldSubsystem.h"
+#include "STargetIndexSubsystem.generated.h"
+
+class APawn;
+class USHealthComponent;
+
+//Live targets of one team. Positions are kept as separate X/Y/Z arrays so distance checks can run 4 at a time
+struct FSTargetTeam
+{
+	TArray<TWeakObjectPtr<APawn>> Pawns;
+
+	TArray<float> X;
+	TArray<float> Y;
+	TArray<float> Z;
+
+	// Grid cell each target is in
+	TArray<FIntPoint> CellOf;
+
+	// Target indices per grid cell
+	TMap<FIntPoint, TArray<int32>> Cells;
+
+	int32 Num() const { return Pawns.Num(); }
+
+	int32 Find(const APawn* Pawn) const;
+
+	void Add(APawn* Pawn, const FVector& Location, const FIntPoint& Cell);
+
+	void RemoveAt(int32 Index);
+
+	void MoveToCell(int32 Index, const FIntPoint& NewCell);
+};
+
+/**
+ * Server side spatial index of live, damageable pawns, one grid per team.
+ * Pawns register through their health component and leave when they die, positions are refreshed once per frame.
+ * Lets bots find their nearest hostile target without walking every pawn in the world.
+ */
+UCLASS()
+class COOPGAME_API USTargetIndexSubsystem : public USTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	virtual void Tick(float DeltaTime) override;
+
+	virtual bool IsTickable() const override;
+
+	virtual TStatId GetStatId() const override;
+
+	void RegisterTarget(APawn* Pawn, uint8 TeamNum);
+
+	void UnregisterTarget(APawn* Pawn);
+
+	/* Nearest live target not on TeamNum, or null if there are none */
+	APawn* FindNearestTarget(const FVector& Location, uint8 TeamNum) const;
+
+	int32 GetNumTargets() const;
+
+	/* Every team, with positions refreshed this frame. For batched passes over all targets */
+	const TMap<uint8, FSTargetTeam>& GetTeams() const { return Teams; }
+
+	/* Every live target of any team within Radius of Location */
+	void GatherTargetsInRadius(const FVector& Location, float Radius, TArray<APawn*>& OutTargets) const;
+
+protected:
+
+	FIntPoint GetCell(const FVector& Location) const;
+
+	/* Nearest target in Team, checking every target. Used for small teams */
+	int32 FindNearestLinear(const FSTargetTeam& Team, const FVector& Location, float& OutDistSquared) const;
+
+	/* Nearest target in Team, searching grid rings outwards from Location */
+	int32 FindNearestInGrid(const FSTargetTeam& Team, const FVector& Location, float& OutDistSquared) const;
+
+	TMap<uint8, FSTargetTeam> Teams;
+};
@@ -0,0 +1,39 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "STickableWorldSubsystem.generated.h"
+
+/**
+ * Base for gameplay world subsystems that need to run once per frame.
+ * Only created for game worlds, ticks after all actors have ticked.
+ */
+UCLASS(Abstract)
+class COOPGAME_API USTickableWorldSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+
+	virtual void Deinitialize() override;
+
+	//FTickableGameObject
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual bool IsTickable() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override;
+
+protected:
+
+	/* True between Initialize and Deinitialize */
+	bool bInitialized;
+
+	/* True if this world is running the server side of the game (dedicated, listen or standalone) */
+	bool IsServerWorld() const;
+};
@@ -0,0 +1,170 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/STickableWorldSubsystem.h"
+#include "STrackerBotSubsystem.generated.h"
+
+class ASTrackerBot;
+struct FBodyInstance;
+
+//Per bot steering flags
+namespace ESTrackerBotSteering
+{
+	enum Type : uint8
+	{
+		OnFlowField = 1 << 0,
+		VelocityChange = 1 << 1,
+		// Set by the steering pass, handled on the game thread after it
+		Reached = 1 << 2,
+		Blocked = 1 << 3,
+		// Steering is refreshed this frame, other bots keep last frames force
+		Due = 1 << 4,
+		// Moved by our own integrator instead of the physics engine
+		Kinematic = 1 << 5,
+		// A hostile came within the self destruct trigger radius, only reported once
+		ProximityTriggered = 1 << 6,
+	};
+}
+
+//How much work a bot gets, by how close it is to the players and whether they can see it
+enum class ESTrackerBotTier : uint8
+{
+	// Steered every frame
+	Full,
+	// Steered every few frames, last force applied in between
+	Reduced,
+	// Physics off, moved kinematically along its path at a low rate
+	Asleep,
+
+	Num
+};
+
+/**
+ * Steers every live tracker bot on the server in one pass per frame, tracker bots don't tick themselves.
+ * Steering state is kept in parallel arrays: positions and path points are gathered from the bots,
+ * forces are worked out in parallel, then applied to all the physics bodies under one scene lock.
+ * Bots only hear back when they reach their path point or stop making progress.
+ * Bots are scored by distance to the nearest player and whether a player is looking their way,
+ * and far bots are steered less often or put to sleep entirely.
+ * Bots normally roll kinematically: forces are integrated here with the same semantics as AddForce and moved with one sweep,
+ * only switching to rigid body physics for a while after an explosion hits them.
+ * Bots don't collide with each other, a separation force from a spatial hash of all bots keeps crowds apart.
+ * Hostile pawns coming close enough to set a bot off are found here too, against the target indexs positions.
+ */
+UCLASS()
+class COOPGAME_API USTrackerBotSubsystem : public USTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	virtual void Tick(float DeltaTime) override;
+
+	virtual bool IsTickable() const override;
+
+	virtual TStatId GetStatId() const override;
+
+	void RegisterBot(ASTrackerBot* Bot);
+
+	void UnregisterBot(ASTrackerBot* Bot);
+
+	int32 GetNumBots() const { return Bots.Num(); }
+
+	int32 GetNumBotsInTier(ESTrackerBotTier Tier) const { return TierCounts[(uint8)Tier]; }
+
+	/* Hand Bot over to rigid body physics for a while, so explosions can throw it around */
+	void WakePhysics(ASTrackerBot* Bot);
+
+	/* Knock a bot that isn't simulating physics, the engine only pushes simulated bodies. Impulse is a velocity change when bVelChange */
+	void AddImpulse(ASTrackerBot* Bot, const FVector& Impulse, bool bVelChange);
+
+protected:
+
+	void RemoveBotAt(int32 Index);
+
+	/* Score every bot against the players views and move bots between tiers */
+	void UpdateSignificance(float Now);
+
+	void SetTier(int32 Index, ESTrackerBotTier NewTier, float Now);
+
+	/* Move a sleeping bot along its steering direction without physics */
+	void MoveAsleepBot(int32 Index);
+
+	/* Apply the bots force, gravity and damping to its velocity, then sweep and slide it along the world */
+	void IntegrateKinematic(int32 Index, float DeltaTime);
+
+	/* Hash every bot into separation sized cells, sorted so each cell is one run of SortedBots */
+	void BuildSeparationGrid();
+
+	/* Push away from bots closer than the separation radius, only looks at the 3x3 cells around the bot */
+	FVector ComputeSeparation(int32 Index) const;
+
+	/* Tell bots about hostile targets inside their trigger radius, checking 4 targets at a time */
+	void UpdateProximity();
+
+	/* Turn physics simulation on or off to match the bots tier and movement mode, carrying its velocity across */
+	void UpdatePhysicsState(int32 Index);
+
+	UPROPERTY()
+	TArray<ASTrackerBot*> Bots;
+
+	TArray<FBodyInstance*> Bodies;
+
+	TArray<FVector> Positions;
+
+	TArray<FVector> NextPoints;
+
+	TArray<FVector> Forces;
+
+	TArray<float> MovementForces;
+
+	TArray<float> RequiredDistances;
+
+	TArray<float> BlockedTimes;
+
+	// Closest each bot has been to its next point, and when. No progress for a while means the path is blocked
+	TArray<float> BestDistances;
+
+	TArray<float> LastProgressTimes;
+
+	TArray<uint8> Flags;
+
+	TArray<uint8> BotTeams;
+
+	TArray<float> TriggerRadii;
+
+	TArray<ESTrackerBotTier> Tiers;
+
+	TArray<float> NextUpdateTimes;
+
+	// Time since each bots last steering update
+	TArray<float> UpdateDeltas;
+
+	TArray<float> LastUpdateTimes;
+
+	// Velocity of bots not simulating physics
+	TArray<FVector> Velocities;
+
+	TArray<float> Masses;
+
+	TArray<float> LinearDampings;
+
+	TArray<float> Radii;
+
+	// Bots stay on physics until this time after an explosion
+	TArray<float> PhysicsUntilTimes;
+
+	// Separation grid, rebuilt each frame. Cell of each bot
+	TArray<uint64> CellKeys;
+
+	TArray<int32> SortedBots;
+
+	// First entry of each cell in SortedBots
+	TMap<uint64, int32> CellStarts;
+
+	int32 TierCounts[(uint8)ESTrackerBotTier::Num];
+
+	float NextSignificanceTime;
+};
@@ -0,0 +1,43 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "SWeakspotSubsystem.generated.h"
+
+class UPhysicsAsset;
+
+/**
+ * Resolves the surface type of a weapon hit without complex traces.
+ * Skeletal mesh hits are mapped from the hit body to a surface through a per physics asset table,
+ * built the first time the asset is hit.
+ */
+UCLASS(Config=Game)
+class COOPGAME_API USWeakspotSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	USWeakspotSubsystem();
+
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+
+	/* Surface type for a weapon hit. Uses the body table for skeletal meshes, the hit physical material otherwise */
+	EPhysicalSurface ResolveSurfaceType(const FHitResult& Hit);
+
+	/* Should weapons trace against complex collision */
+	static bool UseComplexTraces();
+
+protected:
+
+	/* Bones that count as weakspots when their body has no physical material of its own */
+	UPROPERTY(Config)
+	TArray<FName> WeakspotBoneNames;
+
+	const TArray<uint8>& GetSurfaceTable(UPhysicsAsset* PhysicsAsset);
+
+	// Surface type per body index, per physics asset
+	TMap<TWeakObjectPtr<UPhysicsAsset>, TArray<uint8>> SurfaceTables;
+};
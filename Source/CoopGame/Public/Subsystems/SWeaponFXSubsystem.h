@@ -0,0 +1,79 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "SWeaponFXSubsystem.generated.h"
+
+class UParticleSystem;
+class UParticleSystemComponent;
+class USceneComponent;
+
+//Fixed budget of reusable components for one effect
+USTRUCT()
+struct FSWeaponFXPool
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	TArray<UParticleSystemComponent*> Components;
+
+	// Next component to steal when every one is still playing
+	int32 NextIndex;
+
+	FSWeaponFXPool()
+		: NextIndex(0)
+	{
+	}
+};
+
+/**
+ * Pools particle components for weapon effects so firing does not allocate,
+ * and skips effects the local player would not see.
+ * Not created on dedicated servers.
+ */
+UCLASS()
+class COOPGAME_API USWeaponFXSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+
+	virtual void Deinitialize() override;
+
+	/* Play Effect at a location. Returns null if the effect was culled */
+	UParticleSystemComponent* PlayEffectAtLocation(UParticleSystem* Effect, const FVector& Location, const FRotator& Rotation = FRotator::ZeroRotator, bool bAlwaysSignificant = false);
+
+	/* Play Effect attached to a socket. Returns null if the effect was culled */
+	UParticleSystemComponent* PlayEffectAttached(UParticleSystem* Effect, USceneComponent* AttachTo, FName SocketName, bool bAlwaysSignificant);
+
+	/* Play a beam style effect from Start, with its target parameter set to End. Returns null if the effect was culled */
+	UParticleSystemComponent* PlayTracerEffect(UParticleSystem* Effect, const FVector& Start, const FVector& End, FName TargetParamName);
+
+	/* True if an effect at Location could be seen by the local player */
+	bool IsLocationSignificant(const FVector& Location) const;
+
+	/* True if any part of the segment (e.g. a tracer) could be seen by the local player */
+	bool IsSegmentSignificant(const FVector& Start, const FVector& End) const;
+
+	int32 GetNumSpawned() const { return NumSpawned; }
+	int32 GetNumReused() const { return NumReused; }
+	int32 GetNumCulled() const { return NumCulled; }
+
+protected:
+
+	UParticleSystemComponent* AcquireComponent(UParticleSystem* Effect);
+
+	bool GetLocalView(FVector& OutLocation, FVector& OutDirection, float& OutCosHalfFOV) const;
+
+	UPROPERTY()
+	TMap<UParticleSystem*, FSWeaponFXPool> Pools;
+
+	// Totals since the world started
+	int32 NumSpawned;
+	int32 NumReused;
+	int32 NumCulled;
+};
@@ -0,0 +1,104 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/STickableWorldSubsystem.h"
+#include "WorldCollision.h"
+#include "SWeaponTraceSubsystem.generated.h"
+
+class ASWeapon;
+
+//A single hitscan shot waiting for its trace
+struct FSWeaponShot
+{
+	FVector TraceStart;
+
+	FVector TraceEnd;
+
+	FVector ShotDirection;
+
+	// Server time to rewind pawns to, negative if not lag compensated
+	float LagCompensationTimestamp;
+
+	// Seed of the pellet pattern this shot is part of, 0 for a single trace shot
+	int32 PelletSeed;
+
+	uint8 PelletIndex;
+
+	FSWeaponShot()
+		: TraceStart(ForceInitToZero)
+		, TraceEnd(ForceInitToZero)
+		, ShotDirection(ForceInitToZero)
+		, LagCompensationTimestamp(-1.0f)
+		, PelletSeed(0)
+		, PelletIndex(0)
+	{
+	}
+};
+
+//A traced shot, ready to be resolved by its weapon
+struct FSWeaponShotResult
+{
+	FSWeaponShot Shot;
+
+	FHitResult Hit;
+
+	bool bBlockingHit;
+
+	FSWeaponShotResult()
+		: bBlockingHit(false)
+	{
+	}
+};
+
+/**
+ * Collects every weapon shot fired during a frame and traces them as one batch at the end of the frame.
+ * Shots go through the async trace API and are resolved next frame, in one batch per weapon.
+ * Lag compensated shots need the rewound pawns to be in place while tracing, so those are traced synchronously in the batch.
+ */
+UCLASS()
+class COOPGAME_API USWeaponTraceSubsystem : public USTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+
+	virtual void Tick(float DeltaTime) override;
+
+	virtual TStatId GetStatId() const override;
+
+	bool IsEnabled() const;
+
+	void QueueShot(ASWeapon* Weapon, const FSWeaponShot& Shot);
+
+protected:
+
+	struct FSPendingShot
+	{
+		TWeakObjectPtr<ASWeapon> Weapon;
+		FSWeaponShotResult Result;
+		double QueueTime;
+		bool bTraced;
+	};
+
+	void OnTraceCompleted(const FTraceHandle& Handle, FTraceDatum& Data);
+
+	/* Hand last frames traced shots to their weapons, one batch per weapon */
+	void ResolveInFlightShots();
+
+	// Scratch buffer for one weapons batch
+	TArray<FSWeaponShotResult> ResolveBatch;
+
+	// Shots fired this frame
+	TArray<FSPendingShot> QueuedShots;
+
+	// Shots traced at the end of last frame, their results arrive this frame
+	TArray<FSPendingShot> InFlightShots;
+
+	FTraceDelegate TraceDelegate;
+
+	float AverageLatencyMs;
+};